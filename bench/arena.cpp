@@ -0,0 +1,155 @@
+#include "delegate.h"
+#include "arena.h"
+#include "compact.h"
+#include "bench.h"
+
+#include <array>
+#include <cerrno>
+#include <memory>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+static constexpr uint64_t requests = 200000;
+static constexpr int small_per_request = 24;
+static constexpr int large_per_request = 8;
+
+/// A small capture
+///
+struct adder {
+    int operator()(int n) const { return n + base; }
+    int base;
+};
+
+/// A capture too large for state_t
+///
+struct large {
+    int operator()(int n) const { return n + row[n & 7]; }
+    std::array<int, 16> row;
+};
+
+/// Today's lifecycle for a large capture: box it on the heap
+///
+template<class F>
+struct boxed {
+    int operator()(int n) const { return (*fn)(n); }
+    std::unique_ptr<F> fn;
+};
+
+using handler_t = delegate<int, int>;
+
+/// Fills several chunks, then checks that destroying the arena unmapped
+/// the page of every allocation (msync fails with ENOMEM on unmapped
+/// memory).
+///
+static bool releases_every_chunk()
+{
+    constexpr size_t chunks = 8;
+    const auto page = uintptr_t(sysconf(_SC_PAGESIZE));
+
+    std::array<uintptr_t, chunks> pages{};
+
+    {
+        arena a(page);
+        for (auto &p : pages) {
+            p = reinterpret_cast<uintptr_t>(a.allocate(page / 2, 8)) & ~(page - 1);
+        }
+    }
+
+    for (const auto p : pages) {
+        if (msync(reinterpret_cast<void *>(p), page, MS_ASYNC) == 0 || errno != ENOMEM) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// A callable that fits delegate's state but not compact_delegate's
+/// must still make a compact_delegate, through arena_ptr.
+///
+static bool sizes_for_compact()
+{
+    long a0 = 1, a1 = 2, a2 = 3, a3 = 4;
+    auto sum = [a0, a1, a2, a3](long n) { return a0 + a1 + a2 + a3 + n; };
+
+    static_assert(can_emplace<decltype(sum)>());
+    static_assert(!can_emplace<decltype(sum), compact_state_t>());
+
+    arena a;
+    const auto &d = make_delegate<compact_delegate<long, long>>(a, sum);
+
+    return d(5) == 15;
+}
+
+int main()
+{
+    if (!releases_every_chunk()) {
+        printf("arena leaked a chunk\n");
+        return 1;
+    }
+
+    if (!sizes_for_compact()) {
+        printf("arena: compact_delegate called the wrong callable\n");
+        return 1;
+    }
+
+    long heap_sum = 0;
+    long arena_sum = 0;
+    long huge_sum = 0;
+
+    std::vector<handler_t> handlers;
+    handlers.reserve(small_per_request + large_per_request);
+
+    const auto heap_ns = ns_per_op(requests, [&](uint64_t r) {
+        for (int i = 0; i < small_per_request; i++) {
+            handlers.emplace_back(std::in_place_type<adder>, adder{int(r) + i});
+        }
+        for (int i = 0; i < large_per_request; i++) {
+            handlers.emplace_back(std::in_place_type<boxed<large>>,
+                boxed<large>{std::make_unique<large>(large{{int(r), i}})});
+        }
+        for (const auto &h : handlers) {
+            heap_sum += h(1);
+        }
+        handlers.clear();
+    });
+
+    const auto run_arena = [&](arena &a, long &sum) {
+        std::vector<handler_t *> hs;
+        hs.reserve(small_per_request + large_per_request);
+
+        return ns_per_op(requests, [&](uint64_t r) {
+            for (int i = 0; i < small_per_request; i++) {
+                hs.push_back(&make_delegate<handler_t>(a, adder{int(r) + i}));
+            }
+            for (int i = 0; i < large_per_request; i++) {
+                hs.push_back(&make_delegate<handler_t>(a, large{{int(r), i}}));
+            }
+            for (const auto h : hs) {
+                sum += (*h)(1);
+            }
+            hs.clear();
+            a.reset();
+        });
+    };
+
+    arena normal;
+    arena huge(2 * 1024 * 1024, arena::pages::huge);
+
+    const auto arena_ns = run_arena(normal, arena_sum);
+    const auto huge_ns = run_arena(huge, huge_sum);
+
+    if (heap_sum != arena_sum || heap_sum != huge_sum) {
+        printf("sum mismatch\n");
+        return 1;
+    }
+
+    report("per-delegate lifecycle, per request", heap_ns);
+    report("arena, per request", arena_ns);
+    report(huge.hugetlb() ? "arena, hugetlb pages" : "arena, THP advised", huge_ns);
+
+    printf("requests/s: %.2fM per-delegate, %.2fM arena, %.2fM huge arena\n",
+        1000 / heap_ns, 1000 / arena_ns, 1000 / huge_ns);
+}
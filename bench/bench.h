@@ -0,0 +1,146 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file bench.h
+///
+
+#ifndef BFBENCH_H
+#define BFBENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// keep
+///
+/// Forces the compiler to materialize a value so that the work that
+/// produced it cannot be optimized away.
+///
+template<class T>
+static inline void keep(const T &val)
+{ asm volatile("" : : "r,m"(val) : "memory"); }
+
+/// ns_per_op
+///
+/// Runs fn(i) for i in [0, n) and returns the average time per call
+/// in nanoseconds.
+///
+template<class F>
+static double ns_per_op(uint64_t n, F &&fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < n; i++) {
+        fn(i);
+    }
+
+    const auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / n;
+}
+
+/// report
+///
+/// Prints one benchmark result line.
+///
+static inline void report(const char *name, double ns)
+{ printf("%-40s %10.2f ns/op\n", name, ns); }
+
+/// cache misses
+///
+/// Counts last level cache misses of the calling thread using
+/// perf_event_open. If perf events are not available (e.g. in a
+/// container), valid() is false and count() returns 0.
+///
+class cache_misses
+{
+public:
+    cache_misses(uint32_t type = PERF_TYPE_HARDWARE, uint64_t config = PERF_COUNT_HW_CACHE_MISSES)
+    {
+        perf_event_attr attr{};
+
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    cache_misses(const cache_misses &) = delete;
+    cache_misses &operator=(const cache_misses &) = delete;
+
+    ~cache_misses()
+    {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    /// Counts L1 instruction cache misses instead
+    ///
+    static cache_misses l1i()
+    {
+        return cache_misses(PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_L1I |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    }
+
+    bool valid() const noexcept
+    { return m_fd >= 0; }
+
+    void start() noexcept
+    {
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    uint64_t count() noexcept
+    {
+        uint64_t val = 0;
+
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &val, sizeof(val)) != sizeof(val)) {
+                val = 0;
+            }
+        }
+
+        return val;
+    }
+
+private:
+    int m_fd;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "delegate.h"
+#include "compact.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+static constexpr size_t count = 1000000;
+static constexpr uint64_t rounds = 10;
+
+__attribute__((noinline)) int tick(int n)
+{ return n + 1; }
+
+template<class D>
+static void run(const char *name, const std::vector<uint32_t> &order)
+{
+    std::vector<D> ds;
+    ds.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        ds.emplace_back(&tick);
+    }
+
+    int acc = 0;
+    cache_misses misses;
+
+    misses.start();
+    const auto ns = ns_per_op(rounds * count, [&](uint64_t i) {
+        acc += ds[order[i % count]](int(i));
+    });
+    const auto n = misses.count();
+
+    keep(acc);
+
+    printf("%-20s %3lu bytes %8.2f ns/call ", name, sizeof(D), ns);
+    if (misses.valid()) {
+        printf("%8.3f misses/call\n", double(n) / (rounds * count));
+    }
+    else {
+        printf("   (cache miss counter unavailable)\n");
+    }
+}
+
+int main()
+{
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+
+    run<delegate<int, int>>("delegate", order);
+    run<compact_delegate<int, int>>("compact_delegate", order);
+}
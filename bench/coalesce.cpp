@@ -0,0 +1,96 @@
+#include "delegate.h"
+#include "coalesce.h"
+#include "bench.h"
+
+#include <random>
+#include <vector>
+
+static constexpr uint64_t iters = 1 << 20;
+static constexpr size_t count = 64;
+static constexpr uint64_t batch = 256;
+
+struct widget {
+    void render()
+    {
+        for (int i = 0; i < 128; i++) {
+            frame = frame * 31 + uint32_t(val + sum);
+        }
+    }
+
+    void set(int v) { val = v; render(); }
+    void add(int v) { sum += v; render(); }
+
+    int val;
+    long sum;
+    uint32_t frame;
+};
+
+static void merge_sum(std::tuple<int> &pending, const std::tuple<int> &latest)
+{ std::get<0>(pending) += std::get<0>(latest); }
+
+int main()
+{
+    std::vector<widget> plain_ws(count), queue_ws(count);
+    std::vector<delegate<void, int>> plain_set, plain_add, queue_set, queue_add;
+
+    for (size_t i = 0; i < count; i++) {
+        plain_set.emplace_back(&widget::set, &plain_ws[i]);
+        plain_add.emplace_back(&widget::add, &plain_ws[i]);
+        queue_set.emplace_back(&widget::set, &queue_ws[i]);
+        queue_add.emplace_back(&widget::add, &queue_ws[i]);
+    }
+
+    std::mt19937 rng{42};
+    std::geometric_distribution<uint32_t> pick{0.1};
+    std::vector<uint32_t> targets(iters);
+
+    for (auto &t : targets) {
+        t = pick(rng) % count;
+    }
+
+    std::vector<std::pair<const delegate<void, int> *, int>> deferred;
+    const auto run_plain = [&](auto &ds) {
+        return ns_per_op(iters, [&](uint64_t i) {
+            deferred.emplace_back(&ds[targets[i]], int(i));
+            if ((i + 1) % batch == 0) {
+                for (auto &[d, v] : deferred) {
+                    (*d)(int(v));
+                }
+                deferred.clear();
+            }
+        });
+    };
+
+    const auto run_queue = [&](auto &q, auto &ds) {
+        return ns_per_op(iters, [&](uint64_t i) {
+            q.post(ds[targets[i]], int(i));
+            if ((i + 1) % batch == 0) {
+                q.flush();
+            }
+        });
+    };
+
+    coalescing_queue<int> latest;
+    coalescing_queue<int> merged{delegate(&merge_sum)};
+
+    const auto plain_set_ns = run_plain(plain_set);
+    const auto latest_ns = run_queue(latest, queue_set);
+    const auto plain_add_ns = run_plain(plain_add);
+    const auto merged_ns = run_queue(merged, queue_add);
+
+    for (size_t i = 0; i < count; i++) {
+        if (plain_ws[i].val != queue_ws[i].val || plain_ws[i].sum != queue_ws[i].sum) {
+            printf("widget %zu mismatch\n", i);
+            return 1;
+        }
+    }
+
+    report("deferred vector, set", plain_set_ns);
+    report("coalescing_queue, latest args", latest_ns);
+    report("deferred vector, add", plain_add_ns);
+    report("coalescing_queue, merged args", merged_ns);
+
+    printf("coalesce ratio: latest %.2f, merged %.2f (%llu posts)\n",
+        latest.coalesce_ratio(), merged.coalesce_ratio(),
+        static_cast<unsigned long long>(latest.posted()));
+}
@@ -0,0 +1,138 @@
+#include "delegate.h"
+#include "completion.h"
+#include "bench.h"
+
+#include <future>
+#include <vector>
+
+static constexpr uint64_t iters = 10000000;
+
+struct request {
+    void done(int &v) { sum += v; }
+    long sum;
+};
+
+struct join {
+    void joined()
+    {
+        for (auto &p : parts) {
+            sum += p.get();
+        }
+    }
+    completion<int> parts[4];
+    long sum;
+};
+
+struct task_queue {
+    void post(task_t t) { tasks.push_back(std::move(t)); }
+    void run()
+    {
+        for (auto &t : tasks) {
+            t();
+        }
+        tasks.clear();
+    }
+    std::vector<task_t> tasks;
+};
+
+/// Checks that a continuation attached with an executor after the value
+/// is already there is posted, not run inline.
+///
+static bool late_then_uses_executor()
+{
+    task_queue tq;
+    request r{};
+    completion<int> c;
+
+    c.complete(7);
+    c.then(delegate(&request::done, &r), delegate(&task_queue::post, &tq));
+
+    const auto posted = r.sum == 0 && tq.tasks.size() == 1;
+    tq.run();
+
+    return posted && r.sum == 7;
+}
+
+int main()
+{
+    if (!late_then_uses_executor()) {
+        printf("then() after complete() ignored the executor\n");
+        return 1;
+    }
+
+    long expected = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        expected += int(i);
+    }
+
+    request fut{}, own{}, pooled{}, queued{};
+
+    const delegate fut_cb(&request::done, &fut);
+    const auto future_ns = ns_per_op(iters, [&](uint64_t i) {
+        std::promise<int> p;
+        auto f = p.get_future();
+        p.set_value(int(i));
+        auto v = f.get();
+        fut_cb(v);
+    });
+
+    completion<int> c;
+    const delegate own_cb(&request::done, &own);
+    const auto own_ns = ns_per_op(iters, [&](uint64_t i) {
+        c.reset();
+        c.then(own_cb);
+        c.complete(int(i));
+    });
+
+    completion_pool<int> pool(1024);
+    const delegate pool_cb(&request::done, &pooled);
+    const auto pool_ns = ns_per_op(iters, [&](uint64_t i) {
+        auto &pc = pool.acquire();
+        pc.then(pool_cb);
+        pc.complete(int(i));
+        pool.release(pc);
+    });
+
+    task_queue tq;
+    std::vector<completion<int>> batch(256);
+    const delegate exec(&task_queue::post, &tq);
+    const delegate queued_cb(&request::done, &queued);
+    const auto exec_ns = ns_per_op(iters, [&](uint64_t i) {
+        auto &bc = batch[i % 256];
+        bc.reset();
+        bc.then(queued_cb, exec);
+        bc.complete(int(i));
+        if (i % 256 == 255) {
+            tq.run();
+        }
+    });
+    tq.run();
+
+    fan_in fan(4);
+    join fanned{};
+    const delegate joined_cb(&join::joined, &fanned);
+    const auto fan_ns = ns_per_op(iters, [&](uint64_t i) {
+        auto &pc = fanned.parts[i % 4];
+        if (i % 4 == 0) {
+            fan.reset(4);
+            for (auto &p : fanned.parts) {
+                p.reset();
+                fan.attach(p);
+            }
+            fan.then(joined_cb);
+        }
+        pc.complete(int(i));
+    });
+
+    if (fut.sum != expected || own.sum != expected || pooled.sum != expected ||
+        queued.sum != expected || fanned.sum != expected) {
+        printf("sum mismatch\n");
+        return 1;
+    }
+
+    report("std::promise/std::future", future_ns);
+    report("completion, in caller", own_ns);
+    report("completion, pooled", pool_ns);
+    report("completion, then on executor", exec_ns);
+    report("completion, fan-in of 4 (per part)", fan_ns);
+}
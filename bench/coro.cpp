@@ -0,0 +1,156 @@
+#include "delegate.h"
+#include "completion.h"
+#include "coro.h"
+#include "bench.h"
+
+#include <cstdlib>
+
+static constexpr uint64_t iters = 1000000;
+
+/// A task like task, but with frames from the global heap
+///
+struct heap_task {
+    struct promise_type {
+        heap_task get_return_object() noexcept
+        { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+    std::coroutine_handle<> handle;
+};
+
+static uint64_t hops;
+static uint64_t finished;
+
+static task hopper(coro_executor &ex, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i++) {
+        hops++;
+        co_await ex.schedule();
+    }
+}
+
+struct callback_hopper {
+    void step()
+    {
+        hops++;
+        if (++i < n) {
+            ex->post(task_t(&callback_hopper::step, this));
+        }
+    }
+    coro_executor *ex;
+    uint64_t i;
+    uint64_t n;
+};
+
+static task short_task(coro_executor &ex)
+{
+    co_await ex.schedule();
+    finished++;
+}
+
+static heap_task short_heap_task(coro_executor &ex)
+{
+    co_await ex.schedule();
+    finished++;
+}
+
+static void short_callback()
+{ finished++; }
+
+static task waiter(completion<int> &c, long &sum)
+{
+    sum += co_await c;
+}
+
+struct callback_waiter {
+    void done(int &v) { sum += v; }
+    long sum;
+};
+
+int main()
+{
+    coro_executor ex;
+
+    const auto coro_hop = ns_per_op(1, [&](uint64_t) {
+        ex.spawn(hopper(ex, iters));
+        ex.run();
+    }) / iters;
+
+    callback_hopper ch{&ex, 0, iters};
+    const auto callback_hop = ns_per_op(1, [&](uint64_t) {
+        ex.post(task_t(&callback_hopper::step, &ch));
+        ex.run();
+    }) / iters;
+
+    if (hops != 2 * iters) {
+        printf("hop count mismatch\n");
+        return 1;
+    }
+
+    constexpr uint64_t batch = 1024;
+
+    const auto pooled = ns_per_op(iters / batch, [&](uint64_t) {
+        for (uint64_t i = 0; i < batch; i++) {
+            ex.spawn(short_task(ex));
+        }
+        ex.run();
+    }) / batch;
+
+    const auto heap = ns_per_op(iters / batch, [&](uint64_t) {
+        for (uint64_t i = 0; i < batch; i++) {
+            ex.post(resumer(short_heap_task(ex).handle));
+        }
+        ex.run();
+    }) / batch;
+
+    const auto callback = ns_per_op(iters / batch, [&](uint64_t) {
+        for (uint64_t i = 0; i < batch; i++) {
+            ex.post(task_t(&short_callback));
+            ex.post(task_t(&short_callback));
+        }
+        ex.run();
+    }) / batch;
+
+    if (finished != 4 * (iters / batch) * batch) {
+        printf("task count mismatch\n");
+        return 1;
+    }
+
+    long coro_sum = 0;
+    callback_waiter cw{};
+    completion<int> c;
+
+    const auto await_ns = ns_per_op(iters, [&](uint64_t i) {
+        c.reset();
+        ex.spawn(waiter(c, coro_sum));
+        ex.run();
+        c.complete(int(i));
+    });
+
+    const delegate cw_cb(&callback_waiter::done, &cw);
+    const auto then_ns = ns_per_op(iters, [&](uint64_t i) {
+        c.reset();
+        c.then(cw_cb);
+        c.complete(int(i));
+    });
+
+    if (coro_sum != cw.sum) {
+        printf("completion sum mismatch\n");
+        return 1;
+    }
+
+    report("co_await schedule(), per hop", coro_hop);
+    report("callback reposting itself, per hop", callback_hop);
+    report("spawn + 1 hop, pooled frames", pooled);
+    report("spawn + 1 hop, heap frames", heap);
+    report("two callbacks, no frame", callback);
+    report("co_await completion", await_ns);
+    report("completion::then callback", then_ns);
+
+    printf("frames taken from the heap by the pool: %llu of %llu\n",
+        static_cast<unsigned long long>(frame_pool::fresh()),
+        static_cast<unsigned long long>(iters / batch * batch + iters + 1));
+}
@@ -0,0 +1,122 @@
+#include "delegate.h"
+#include "dispatcher.h"
+#include "bench.h"
+
+#include <functional>
+#include <new>
+#include <random>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+static constexpr size_t types = 50;
+static constexpr uint64_t iters = 20000000;
+
+template<size_t N>
+struct msg {
+    uint64_t val;
+};
+
+struct sink {
+    template<class T>
+    void on(const T &m) { total += m.val; }
+
+    uint64_t total;
+};
+
+template<size_t... I>
+static auto make_dispatcher(std::index_sequence<I...>) -> dispatcher<msg<I>...>;
+
+using dispatcher_t = decltype(make_dispatcher(std::make_index_sequence<types>{}));
+using map_t = std::unordered_map<std::type_index, std::vector<std::function<void(const void *)>>>;
+
+template<size_t... I>
+static void subscribe_all(dispatcher_t &d, map_t &map, sink &s, std::index_sequence<I...>)
+{
+    (d.subscribe<msg<I>>(delegate(&sink::on<msg<I>>, &s)), ...);
+    ((map[std::type_index(typeid(msg<I>))].emplace_back(
+        [&s](const void *m) { s.on(*static_cast<const msg<I> *>(m)); })), ...);
+}
+
+template<size_t... I>
+static void dispatch_typed(const dispatcher_t &d, size_t type, uint64_t val, std::index_sequence<I...>)
+{
+    // What a decoder does: switch on the wire type, then dispatch the
+    // concrete message.
+    ((type == I ? d.dispatch(msg<I>{val}) : void()), ...);
+}
+
+template<size_t... I>
+static void dispatch_map(const map_t &map, size_t type, uint64_t val, std::index_sequence<I...>)
+{
+    ((type == I ? [&] {
+        const msg<I> m{val};
+        for (const auto &h : map.find(std::type_index(typeid(msg<I>)))->second) {
+            h(&m);
+        }
+    }() : void()), ...);
+}
+
+template<size_t... I>
+static const void *decode(void *buf, size_t type, uint64_t val, std::index_sequence<I...>)
+{
+    // What a generic decoder does: construct the message of the wire
+    // type in a buffer and hand it on type-erased.
+    const void *m = nullptr;
+    ((type == I ? void(m = new (buf) msg<I>{val}) : void()), ...);
+    return m;
+}
+
+int main()
+{
+    constexpr auto seq = std::make_index_sequence<types>{};
+
+    dispatcher_t d;
+    map_t map;
+    sink s{};
+
+    subscribe_all(d, map, s, seq);
+
+    std::vector<uint8_t> order(4096);
+    std::mt19937 rng(42);
+    for (auto &t : order) {
+        t = static_cast<uint8_t>(rng() % types);
+    }
+
+    const auto hash = ns_per_op(iters, [&](uint64_t i) {
+        dispatch_map(map, order[i % order.size()], i, seq);
+    });
+    const auto sum_map = s.total;
+
+    s.total = 0;
+    const auto typed = ns_per_op(iters, [&](uint64_t i) {
+        dispatch_typed(d, order[i % order.size()], i, seq);
+    });
+    const auto sum_typed = s.total;
+
+    s.total = 0;
+    // Every msg<N> has the same size and alignment, so one buffer can
+    // hold a decoded message of any type.
+
+    alignas(msg<0>) uint8_t buf[sizeof(msg<0>)];
+    const auto erased = ns_per_op(iters, [&](uint64_t i) {
+        const auto type = order[i % order.size()];
+        d.dispatch(type, decode(buf, type, i, seq));
+    });
+    const auto sum_erased = s.total;
+
+    if (sum_map != sum_typed || sum_map != sum_erased) {
+        printf("dispatcher mismatch\n");
+        return 1;
+    }
+
+    if (d.dispatch(types, buf) || d.dispatch(~size_t{0}, buf) || s.total != sum_erased) {
+        printf("dispatcher: dispatched an unknown type\n");
+        return 1;
+    }
+
+    printf("%lu message types, one handler each (ns per dispatch)\n", types);
+    report("  type_index map of std::function", hash);
+    report("  dispatcher, static type", typed);
+    report("  dispatcher, run-time id", erased);
+}
@@ -0,0 +1,89 @@
+#include "delegate.h"
+#include "handlers.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+static constexpr size_t sources = 4096;
+static constexpr uint64_t rounds = 200;
+
+struct subscriber {
+    void on(int n) { total += n; }
+    long total;
+};
+
+/// Adds a list's own handlers to it until it spills to the heap and
+/// grows again; each add must copy its argument before the storage it
+/// lives in is moved and freed.
+///
+static bool adds_own_handlers()
+{
+    subscriber sub{};
+    handler_list<2, int> list;
+
+    list.add(delegate(&subscriber::on, &sub));
+    while (list.size() < 16) {
+        list.add(*(list.end() - 1));
+    }
+
+    list(1);
+    return sub.total == 16;
+}
+
+int main()
+{
+    if (!adds_own_handlers()) {
+        printf("handler_list: self add lost a handler\n");
+        return 1;
+    }
+
+    std::vector<uint32_t> order(sources);
+    for (size_t i = 0; i < sources; i++) {
+        order[i] = uint32_t(i);
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937{42});
+
+    for (const size_t count : {1, 2, 4, 16}) {
+        std::vector<subscriber> subs(count);
+        std::vector<std::vector<delegate<void, int>>> vecs(sources);
+        std::vector<handler_list<4, int>> lists(sources);
+
+        const auto vec_build = ns_per_op(sources, [&](uint64_t s) {
+            for (auto &sub : subs) {
+                vecs[s].emplace_back(&subscriber::on, &sub);
+            }
+        });
+
+        const auto list_build = ns_per_op(sources, [&](uint64_t s) {
+            for (auto &sub : subs) {
+                lists[s].add(delegate(&subscriber::on, &sub));
+            }
+        });
+
+        const auto vec_call = ns_per_op(rounds * sources, [&](uint64_t i) {
+            for (const auto &d : vecs[order[i % sources]]) {
+                d(1);
+            }
+        });
+
+        const auto list_call = ns_per_op(rounds * sources, [&](uint64_t i) {
+            lists[order[i % sources]](1);
+        });
+
+        for (auto &sub : subs) {
+            if (sub.total != long(2 * rounds * sources)) {
+                printf("call count mismatch\n");
+                return 1;
+            }
+        }
+
+        printf("%zu handlers (handler_list is %s)\n", count,
+            lists[0].is_inline() ? "inline" : "spilled");
+        report("std::vector<delegate>, build", vec_build);
+        report("handler_list<4>, build", list_build);
+        report("std::vector<delegate>, call all (random)", vec_call);
+        report("handler_list<4>, call all (random)", list_call);
+    }
+}
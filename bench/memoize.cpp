@@ -0,0 +1,112 @@
+#include "delegate.h"
+#include "memoize.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+static constexpr uint64_t iters = 1000000;
+static constexpr size_t keys = 100000;
+
+struct protocol {
+    uint32_t lookup(uint32_t key, uint16_t port)
+    {
+        uint32_t h = key ^ seed;
+        for (int i = 0; i < 64; i++) {
+            h = (h ^ port) * 0x01000193 + uint32_t(i);
+        }
+        return h;
+    }
+    uint32_t seed;
+};
+
+static std::vector<uint32_t> zipf_stream(size_t n, double s)
+{
+    std::vector<double> cdf(keys);
+
+    double sum = 0;
+    for (size_t i = 0; i < keys; i++) {
+        cdf[i] = sum += 1.0 / std::pow(double(i + 1), s);
+    }
+
+    std::mt19937_64 rng{42};
+    std::uniform_real_distribution<double> uni{0, sum};
+    std::vector<uint32_t> out(n);
+
+    for (auto &k : out) {
+        k = uint32_t(std::lower_bound(cdf.begin(), cdf.end(), uni(rng)) - cdf.begin());
+    }
+
+    return out;
+}
+
+template<class M>
+static bool run(const char *name, M &m, protocol &p, const std::vector<uint32_t> &stream)
+{
+    for (size_t i = 0; i < 1000; i++) {
+        if (m(stream[i], 80) != p.lookup(stream[i], 80)) {
+            printf("%s: result mismatch\n", name);
+            return false;
+        }
+    }
+
+    const auto ns = ns_per_op(iters, [&](uint64_t i) {
+        keep(m(stream[i], 80));
+    });
+
+    report(name, ns);
+    printf("%-40s %10.2f %% hits\n", "", 100.0 * m.hits() / double(m.hits() + m.misses()));
+
+    return true;
+}
+
+/// Creates and destroys per-thread memoized objects one after another.
+/// Each reuses the previous one's id, and must start from an empty
+/// table rather than its predecessor's results.
+///
+static bool reuses_thread_tables()
+{
+    for (uint32_t seed = 0; seed < 64; seed++) {
+        protocol q{seed};
+        thread_memoized<64, uint32_t, uint32_t, uint16_t> m(delegate(&protocol::lookup, &q));
+
+        if (m(1, 80) != q.lookup(1, 80) || m.hits() != 0 || m.misses() != 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    if (!reuses_thread_tables()) {
+        printf("thread_memoized: stale table\n");
+        return 1;
+    }
+
+    protocol p{0x811c9dc5};
+    delegate d(&protocol::lookup, &p);
+
+    for (const auto s : {0.8, 0.99, 1.2}) {
+        const auto stream = zipf_stream(iters, s);
+        printf("zipf s = %.2f over %zu keys\n", s, keys);
+
+        const auto direct = ns_per_op(iters, [&](uint64_t i) {
+            keep(d(uint32_t(stream[i]), uint16_t(80)));
+        });
+        report("delegate", direct);
+
+        memoized<1024, uint32_t, uint32_t, uint16_t> small(d);
+        memoized<16384, uint32_t, uint32_t, uint16_t> large(d);
+        thread_memoized<16384, uint32_t, uint32_t, uint16_t> shard(d);
+
+        if (!run("memoized<1024>", small, p, stream) ||
+            !run("memoized<16384>", large, p, stream) ||
+            !run("thread_memoized<16384>", shard, p, stream)) {
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#include "delegate.h"
+#include "multicast.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+static constexpr uint64_t iters = 100000;
+
+struct listener {
+    void notify(int n) { total += n; }
+    long total;
+};
+
+/// Adds a list's own last handler to it as it grows, then removes
+/// handlers from the front so the last one is moved and re-indexed.
+///
+static bool adds_own_handlers()
+{
+    std::vector<listener> ls(4);
+    multicast<int> mc;
+
+    for (auto &l : ls) {
+        mc.add(delegate(&listener::notify, &l));
+    }
+    while (mc.size() < 64) {
+        mc.add(*(mc.end() - 1));
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (!mc.remove(delegate(&listener::notify, &ls[size_t(i)]))) {
+            return false;
+        }
+    }
+
+    mc(1);
+    return mc.size() == 61 && ls[3].total == 61 &&
+           mc.contains(delegate(&listener::notify, &ls[3]));
+}
+
+int main()
+{
+    if (!adds_own_handlers()) {
+        printf("multicast: self add broke the index\n");
+        return 1;
+    }
+
+    for (const size_t count : {16, 256, 4096}) {
+        std::vector<listener> ls(count);
+        std::vector<delegate<void, int>> scan;
+        multicast<int> mc;
+
+        for (auto &l : ls) {
+            scan.emplace_back(&listener::notify, &l);
+            mc.add(delegate(&listener::notify, &l));
+        }
+
+        std::mt19937 rng{42};
+        std::vector<uint32_t> picks(iters);
+        for (auto &p : picks) {
+            p = rng() % count;
+        }
+
+        const auto scan_ns = ns_per_op(iters, [&](uint64_t i) {
+            const delegate d(&listener::notify, &ls[picks[i]]);
+            const auto it = std::find(scan.begin(), scan.end(), d);
+            *it = std::move(scan.back());
+            scan.pop_back();
+            scan.push_back(d);
+        });
+
+        const auto index_ns = ns_per_op(iters, [&](uint64_t i) {
+            const delegate d(&listener::notify, &ls[picks[i]]);
+            if (!mc.remove(d)) {
+                std::terminate();
+            }
+            mc.add(d);
+        });
+
+        mc(1);
+        for (auto &l : ls) {
+            if (l.total != 1 || !mc.contains(delegate(&listener::notify, &l))) {
+                printf("multicast mismatch\n");
+                return 1;
+            }
+        }
+
+        if (mc.size() != count || scan.size() != count) {
+            printf("size mismatch\n");
+            return 1;
+        }
+
+        printf("%zu handlers\n", count);
+        report("vector, find and erase", scan_ns);
+        report("multicast, remove by value", index_ns);
+    }
+}
@@ -0,0 +1,70 @@
+#include "delegate.h"
+#include "bench.h"
+
+#include <optional>
+#include <random>
+#include <vector>
+
+static constexpr size_t slots = 256;
+static constexpr uint64_t iters = 1 << 22;
+
+struct counter {
+    void on(int n) { total += n; }
+    long total;
+};
+
+int main()
+{
+    std::vector<uint8_t> ops(iters);
+    std::mt19937 rng{42};
+
+    for (auto &op : ops) {
+        op = uint8_t(rng());
+    }
+
+    printf("sizeof(delegate) == %zu, sizeof(std::optional<delegate>) == %zu\n",
+        sizeof(delegate<void, int>), sizeof(std::optional<delegate<void, int>>));
+
+    for (const size_t filled : {16, 128, 240}) {
+        counter opt_count{};
+        counter empty_count{};
+
+        std::vector<std::optional<delegate<void, int>>> opt_table(slots);
+        std::vector<delegate<void, int>> empty_table(slots);
+
+        for (size_t i = 0; i < filled; i++) {
+            opt_table[i * slots / filled].emplace(&counter::on, &opt_count);
+            empty_table[i * slots / filled] = delegate(&counter::on, &empty_count);
+        }
+
+        const auto opt_call = ns_per_op(iters, [&](uint64_t i) {
+            const auto &d = opt_table[ops[i]];
+            if (d) {
+                (*d)(1);
+            }
+        });
+
+        const auto empty_call = ns_per_op(iters, [&](uint64_t i) {
+            empty_table[ops[i]](1);
+        });
+
+        if (opt_count.total != empty_count.total) {
+            printf("call count mismatch\n");
+            return 1;
+        }
+
+        size_t set = 0;
+        for (const auto &d : empty_table) {
+            set += bool(d);
+        }
+
+        if (set != filled) {
+            printf("operator bool mismatch\n");
+            return 1;
+        }
+
+        printf("%zu of %zu slots set\n", filled, slots);
+        report("std::optional<delegate>, check and call", opt_call);
+        report("empty delegate, call", empty_call);
+    }
+}
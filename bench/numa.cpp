@@ -0,0 +1,66 @@
+#include "delegate.h"
+#include "numa.h"
+#include "bench.h"
+
+#include <vector>
+
+static constexpr uint64_t iters = 10000000;
+static constexpr size_t count = 256;
+
+struct handler {
+    int on(int n) { return val + n; }
+    int val;
+};
+
+int main()
+{
+    std::vector<handler> hs(count);
+    for (size_t i = 0; i < count; i++) {
+        hs[i].val = int(i);
+    }
+
+    const delegate first(&handler::on, &hs[0]);
+    std::vector<delegate<int, int>> plain(count, first);
+    replicated_table<int, int> table(count, first);
+
+    for (size_t i = 0; i < count; i++) {
+        const delegate d(&handler::on, &hs[i]);
+        plain[i] = d;
+        table.set(i, d);
+    }
+    table.reclaim();
+
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t node = 0; node < table.nodes(); node++) {
+            if (table.replica(node, i)(1) != plain[i](1)) {
+                printf("replica mismatch\n");
+                return 1;
+            }
+        }
+    }
+
+    int acc = 0;
+
+    const auto plain_ns = ns_per_op(iters, [&](uint64_t i) {
+        acc += plain[i % count](int(i));
+    });
+
+    const auto table_ns = ns_per_op(iters, [&](uint64_t i) {
+        acc += table(i % count, int(i));
+    });
+
+    replicated_table<int, int> wide(count, first, 4);
+    const auto set_ns = ns_per_op(10000, [&](uint64_t i) {
+        wide.set(i % count, plain[i % count]);
+        if (i % 64 == 63) {
+            wide.reclaim();
+        }
+    });
+
+    keep(acc);
+
+    printf("%u NUMA node(s)\n", numa_topology::system().nodes());
+    report("std::vector<delegate> call", plain_ns);
+    report("replicated_table call", table_ns);
+    report("replicated_table set, 4 replicas", set_ns);
+}
@@ -0,0 +1,110 @@
+#include "delegate.h"
+#include "invoke.h"
+#include "parallel.h"
+#include "bench.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static constexpr size_t count = 4096;
+static constexpr uint64_t rounds = 20;
+
+// Counts its copies: invoke_parallel_reduce must hand every chunk the
+// caller's object.
+
+struct table {
+    table() = default;
+    table(const table &other) : vals{other.vals}
+    { copies++; }
+
+    std::vector<uint64_t> vals;
+    static inline int copies;
+};
+
+struct subscriber {
+    uint64_t on(uint64_t n)
+    {
+        auto h = seed ^ n;
+        for (int i = 0; i < 2000; i++) {
+            h = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9;
+        }
+        return h & 0xffff;
+    }
+    void touch(uint64_t) { touched++; }
+    uint64_t pick(const table &t) { return t.vals[seed]; }
+    uint64_t seed;
+    uint64_t touched;
+};
+
+int main()
+{
+    std::vector<subscriber> subs(count);
+    std::vector<delegate<uint64_t, uint64_t>> ds;
+
+    for (size_t i = 0; i < count; i++) {
+        subs[i].seed = i;
+        ds.emplace_back(&subscriber::on, &subs[i]);
+    }
+
+    std::vector<delegate<void, uint64_t>> touches;
+    for (auto &s : subs) {
+        touches.emplace_back(&subscriber::touch, &s);
+    }
+
+    std::vector<delegate<uint64_t, const table &>> picks;
+    for (auto &s : subs) {
+        picks.emplace_back(&subscriber::pick, &s);
+    }
+
+    const auto first = ds.data();
+    const auto last = ds.data() + count;
+
+    table t;
+    t.vals.assign(count, 3);
+
+    uint64_t expected = 0;
+    const auto serial = ns_per_op(rounds, [&](uint64_t r) {
+        expected += invoke_reduce(first, last, reduce_sum<uint64_t>{}, r);
+    });
+
+    const auto hw = std::max(1u, std::thread::hardware_concurrency());
+    printf("%u hardware threads; rows with more threads are oversubscribed\n", hw);
+    printf("serial: %.2f ms per multicast of %zu handlers\n", serial / 1e6, count);
+
+    uint64_t runs = 0;
+    for (uint32_t threads = 1; threads <= 8; threads *= 2) {
+        work_pool pool(threads - 1);
+        uint64_t sum = 0;
+
+        const auto ns = ns_per_op(rounds, [&](uint64_t r) {
+            sum += invoke_parallel_reduce(pool, first, last, reduce_sum<uint64_t>{}, r);
+        });
+
+        invoke_parallel(pool, touches.data(), touches.data() + count, uint64_t(0));
+        runs++;
+
+        if (sum != expected) {
+            printf("reduction mismatch\n");
+            return 1;
+        }
+
+        const auto picked = invoke_parallel_reduce(
+            pool, picks.data(), picks.data() + count, reduce_sum<uint64_t>{}, t);
+
+        if (picked != 3 * count || table::copies != 0) {
+            printf("invoke_parallel_reduce: %lu, %d table copies\n", picked, table::copies);
+            return 1;
+        }
+
+        for (const auto &s : subs) {
+            if (s.touched != runs) {
+                printf("invoke_parallel missed a handler\n");
+                return 1;
+            }
+        }
+
+        printf("%u threads: %8.2f ms, speedup %.2fx%s\n", threads, ns / 1e6, serial / ns,
+            threads > hw ? " (oversubscribed)" : "");
+    }
+}
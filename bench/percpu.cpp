@@ -0,0 +1,96 @@
+#include "delegate.h"
+#include "percpu.h"
+#include "bench.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+static constexpr uint64_t per_thread = 1000000;
+
+struct alignas(64) worker {
+    void receive() { received++; }
+    uint64_t received;
+    uint64_t wakeups;
+};
+
+static void pin(uint32_t cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void run(percpu_queues &q, std::vector<worker> &ws, uint32_t self, uint32_t batch, uint32_t hw)
+{
+    pin(self % hw);
+
+    const auto to = (self + 1) % q.cpus();
+    const percpu_queues::task_t t(&worker::receive, &ws[to]);
+    auto &w = ws[self];
+
+    uint64_t sent = 0;
+    while (sent < per_thread || w.received < per_thread) {
+        for (uint32_t i = 0; i < batch && sent < per_thread; i++) {
+            if (!q.post(self, to, t)) {
+                break;
+            }
+            sent++;
+        }
+
+        w.wakeups += q.flush(self);
+
+        if (q.drain(self) == 0) {
+            if (sent == per_thread) {
+                q.wait(self);
+            }
+            else {
+                sched_yield();
+            }
+        }
+    }
+}
+
+int main()
+{
+    const auto hw = std::max(1u, std::thread::hardware_concurrency());
+    printf("%u hardware threads; rows with more threads are oversubscribed\n", hw);
+
+    for (const uint32_t batch : {1, 64}) {
+        for (const uint32_t threads : {1, 2, 4, 8}) {
+            percpu_queues q(threads, 1024);
+            std::vector<worker> ws(threads);
+            std::vector<std::thread> ts;
+
+            const auto start = std::chrono::steady_clock::now();
+
+            for (uint32_t i = 0; i < threads; i++) {
+                ts.emplace_back(run, std::ref(q), std::ref(ws), i, batch, hw);
+            }
+            for (auto &t : ts) {
+                t.join();
+            }
+
+            const auto stop = std::chrono::steady_clock::now();
+            const auto ns = std::chrono::duration<double, std::nano>(stop - start).count();
+
+            uint64_t wakeups = 0;
+            for (const auto &w : ws) {
+                if (w.received != per_thread) {
+                    printf("received count mismatch\n");
+                    return 1;
+                }
+                wakeups += w.wakeups;
+            }
+
+            const auto posts = double(per_thread) * threads;
+            printf("batch %2u, %u threads: %8.2f Mposts/s, %6.2f posts per wakeup%s\n",
+                batch, threads, posts / ns * 1000, posts / double(wakeups),
+                threads > hw ? " (oversubscribed)" : "");
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#include "delegate.h"
+#include "bench.h"
+
+static constexpr uint64_t iters = 50000000;
+
+__attribute__((noinline)) int decode(int raw)
+{ return raw ^ 0x5a; }
+
+__attribute__((noinline)) int validate(int msg)
+{ return msg & 0xfff; }
+
+__attribute__((noinline)) int route(int msg)
+{ return msg % 7; }
+
+int main()
+{
+    delegate decd(&decode);
+    delegate vald(&validate);
+    delegate rted(&route);
+
+    auto chain = then(decd, vald, rted);
+    auto fuse = then(&decode, &validate, &route);
+    auto comp = compose(&route, &validate, &decode);
+
+    for (int i = 0; i < 1000; i++) {
+        if (rted(vald(decd(int(i)))) != fuse(int(i)) ||
+            chain(int(i)) != fuse(int(i)) || comp(int(i)) != fuse(int(i))) {
+            printf("pipeline mismatch at %d\n", i);
+            return 1;
+        }
+    }
+
+    int acc = 0;
+
+    const auto direct = ns_per_op(iters, [&](uint64_t i) {
+        acc += route(validate(decode(int(i))));
+    });
+    const auto separate = ns_per_op(iters, [&](uint64_t i) {
+        acc += rted(vald(decd(int(i))));
+    });
+    const auto chained = ns_per_op(iters, [&](uint64_t i) {
+        acc += chain(int(i));
+    });
+    const auto fused = ns_per_op(iters, [&](uint64_t i) {
+        acc += fuse(int(i));
+    });
+
+    keep(acc);
+
+    report("direct calls (per stage)", direct / 3);
+    report("3 delegates (per stage)", separate / 3);
+    report("then(delegates) chained (per stage)", chained / 3);
+    report("then(fnptrs) fused (per stage)", fused / 3);
+}
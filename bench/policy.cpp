@@ -0,0 +1,61 @@
+#include "delegate.h"
+#include "bench.h"
+
+static constexpr uint64_t iters = 20000000;
+
+struct handler {
+    int on(int n) { return val += n; }
+    int val;
+};
+
+__attribute__((noinline)) int free_handler(int n)
+{ return n * 3; }
+
+template<class Storage, class Dispatch, class Make>
+static void run(const char *name, Make make)
+{
+    using D = basic_delegate<Storage, Dispatch, int, int>;
+
+    int acc = 0;
+    D d(make());
+
+    const auto invoke = ns_per_op(iters, [&](uint64_t i) {
+        acc += d(int(i));
+    });
+    const auto copy = ns_per_op(iters, [&](uint64_t i) {
+        D c(d);
+        acc += c(int(i));
+    });
+    const auto create = ns_per_op(iters, [&](uint64_t i) {
+        D n(make());
+        acc += n(int(i));
+    });
+
+    keep(acc);
+    printf("%-30s %3lu bytes %8.2f %8.2f %8.2f\n",
+        name, sizeof(D), invoke, copy, create);
+}
+
+template<class Make>
+static void matrix(const char *what, Make make)
+{
+    printf("\n%-30s %9s %8s %8s %8s\n", what, "size", "invoke", "copy", "create");
+
+    run<inline_storage<>, manager_dispatch>("inline / manager", make);
+    run<inline_storage<>, vtable_dispatch>("inline / vtable", make);
+    run<inline_storage<>, trivial_dispatch>("inline / trivial", make);
+    run<pooled_storage<>, manager_dispatch>("inline+pool / manager", make);
+    run<pooled_storage<>, vtable_dispatch>("inline+pool / vtable", make);
+    run<pooled_storage<>, trivial_dispatch>("inline+pool / trivial", make);
+    run<ref_storage, manager_dispatch>("non-owning / manager", make);
+    run<ref_storage, vtable_dispatch>("non-owning / vtable", make);
+    run<ref_storage, trivial_dispatch>("non-owning / trivial", make);
+}
+
+int main()
+{
+    handler h{};
+
+    matrix("function pointer (ns/op)", [] { return &free_handler; });
+    matrix("bind<&handler::on> (ns/op)", [&] { return bind<&handler::on>(&h); });
+}
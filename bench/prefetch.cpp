@@ -0,0 +1,113 @@
+#include "delegate.h"
+#include "compact.h"
+#include "invoke.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+static constexpr size_t count = 1000000;
+static constexpr uint64_t rounds = 10;
+
+struct alignas(64) handler {
+    int on(int n) { return val += n; }
+    int val;
+};
+
+// invoke_all passes arguments as the delegates declare them: a
+// reference parameter sees the caller's object and is never copied.
+
+struct copies {
+    copies() = default;
+    copies(const copies &)
+    { n++; }
+
+    static inline int n;
+};
+
+struct sink {
+    void add(int &total)
+    { total++; }
+
+    void look(const copies &)
+    {}
+};
+
+static bool passes_references()
+{
+    sink s;
+    std::vector<delegate<void, int &>> adds(20, delegate(&sink::add, &s));
+    std::vector<delegate<void, const copies &>> looks(20, delegate(&sink::look, &s));
+
+    int total = 0;
+    copies c;
+
+    invoke_all<4>(adds.data(), adds.data() + adds.size(), total);
+    invoke_all<4>(looks.data(), looks.data() + looks.size(), c);
+
+    if (total != 20 || copies::n != 0) {
+        printf("invoke_all: total %d, %d copies\n", total, copies::n);
+        return false;
+    }
+
+    return true;
+}
+
+template<class D>
+static void run(const char *name)
+{
+    // Handlers are allocated in shuffled order so that neither the
+    // delegates nor the objects they point to are walked sequentially
+    // by the hardware prefetcher.
+
+    auto hs = std::make_unique<handler[]>(count);
+    std::vector<handler *> ptrs(count);
+
+    for (size_t i = 0; i < count; i++) {
+        ptrs[i] = &hs[i];
+    }
+    std::shuffle(ptrs.begin(), ptrs.end(), std::mt19937(42));
+
+    std::vector<D> ds;
+    ds.reserve(count);
+
+    for (auto p : ptrs) {
+        ds.emplace_back(&handler::on, p);
+    }
+
+    const auto first = ds.data();
+    const auto last = ds.data() + ds.size();
+
+    const auto plain = ns_per_op(rounds, [&](uint64_t) {
+        for (const auto &d : ds) {
+            d(1);
+        }
+    });
+    const auto pf4 = ns_per_op(rounds, [&](uint64_t) {
+        invoke_all<4>(first, last, 1);
+    });
+    const auto pf8 = ns_per_op(rounds, [&](uint64_t) {
+        invoke_all<8>(first, last, 1);
+    });
+    const auto pf16 = ns_per_op(rounds, [&](uint64_t) {
+        invoke_all<16>(first, last, 1);
+    });
+
+    printf("%s, %lu handlers (ns/call)\n", name, count);
+    report("  plain loop", plain / count);
+    report("  invoke_all<4>", pf4 / count);
+    report("  invoke_all<8>", pf8 / count);
+    report("  invoke_all<16>", pf16 / count);
+}
+
+int main()
+{
+    if (!passes_references()) {
+        return 1;
+    }
+
+    run<delegate<int, int>>("delegate");
+    run<compact_delegate<int, int>>("compact_delegate");
+}
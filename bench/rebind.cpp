@@ -0,0 +1,52 @@
+#include "delegate.h"
+#include "bench.h"
+
+#include <vector>
+
+static constexpr uint64_t iters = 20000000;
+static constexpr size_t conns = 1024;
+
+struct connection {
+    int on_read(int n) { return bytes += n; }
+    int on_write(int n) { return bytes -= n; }
+    int bytes;
+};
+
+int main()
+{
+    std::vector<connection> cs(conns);
+    std::vector<delegate<int, int>> hs;
+
+    for (auto &c : cs) {
+        hs.emplace_back(&connection::on_read, &c);
+    }
+
+    int acc = 0;
+
+    const auto assign = ns_per_op(iters, [&](uint64_t i) {
+        const auto k = i % conns;
+        if (i & 1) {
+            hs[k] = delegate(&connection::on_write, &cs[k]);
+        }
+        else {
+            hs[k] = delegate(&connection::on_read, &cs[k]);
+        }
+        acc += hs[k](1);
+    });
+
+    const auto rebind = ns_per_op(iters, [&](uint64_t i) {
+        const auto k = i % conns;
+        if (i & 1) {
+            hs[k].rebind(&connection::on_write, &cs[k]);
+        }
+        else {
+            hs[k].rebind(&connection::on_read, &cs[k]);
+        }
+        acc += hs[k](1);
+    });
+
+    keep(acc);
+
+    report("rebind via temporary + move assign", assign);
+    report("rebind in place", rebind);
+}
@@ -0,0 +1,120 @@
+#include "delegate.h"
+#include "invoke.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+static constexpr uint64_t iters = 100000;
+static constexpr size_t count = 1000;
+
+// A lookup table that counts its copies; invoke_reduce must pass it to
+// const table & parameters without making any.
+
+struct table {
+    table() = default;
+    table(const table &other) : vals{other.vals}
+    { copies++; }
+
+    std::vector<int> vals;
+    static inline int copies;
+};
+
+struct handler {
+    int cost(int n) { return val + n; }
+    int pick(const table &t) { return t.vals[size_t(val)]; }
+    bool count(int &seen) { return ++seen == 10; }
+    bool handles(int n) { return val == n; }
+    std::optional<int> lookup(int n) { return val == n ? std::optional(val) : std::nullopt; }
+    int val;
+};
+
+int main()
+{
+    std::vector<handler> hs(count);
+    std::vector<delegate<int, int>> costs;
+    std::vector<delegate<bool, int>> handles;
+    std::vector<delegate<std::optional<int>, int>> lookups;
+
+    for (size_t i = 0; i < count; i++) {
+        hs[i].val = int(i);
+        costs.emplace_back(&handler::cost, &hs[i]);
+        handles.emplace_back(&handler::handles, &hs[i]);
+        lookups.emplace_back(&handler::lookup, &hs[i]);
+    }
+
+    const auto cf = costs.data();
+    const auto cl = costs.data() + count;
+    const auto hf = handles.data();
+    const auto hl = handles.data() + count;
+    const auto lf = lookups.data();
+    const auto ll = lookups.data() + count;
+
+    int expected = 0;
+    for (size_t i = 0; i < count; i++) {
+        expected += int(i) + 1;
+    }
+
+    if (invoke_reduce(cf, cl, reduce_sum<int>{}, 1) != expected ||
+        invoke_reduce(cf, cl, reduce_min<int>{}, 1) != 1 ||
+        invoke_reduce(cf, cl, reduce_max<int>{}, 1) != int(count) ||
+        !invoke_reduce(hf, hl, reduce_any{}, 500) ||
+        invoke_reduce(hf, hl, reduce_all{}, 500) ||
+        invoke_reduce(lf, ll, reduce_first<std::optional<int>>{}, 500) != 500) {
+        printf("reduction mismatch\n");
+        return 1;
+    }
+
+    std::vector<delegate<int, const table &>> picks;
+    std::vector<delegate<bool, int &>> counts;
+
+    for (auto &h : hs) {
+        picks.emplace_back(&handler::pick, &h);
+        counts.emplace_back(&handler::count, &h);
+    }
+
+    table t;
+    t.vals.assign(count, 2);
+    int seen = 0;
+
+    if (invoke_reduce(picks.data(), picks.data() + count, reduce_sum<int>{}, t) != 2 * int(count) ||
+        !invoke_reduce(counts.data(), counts.data() + count, reduce_any{}, seen) ||
+        seen != 10 || table::copies != 0) {
+        printf("invoke_reduce: seen %d, %d table copies\n", seen, table::copies);
+        return 1;
+    }
+
+    int acc = 0;
+    std::vector<int> vals;
+
+    const auto collect = ns_per_op(iters, [&](uint64_t i) {
+        vals.clear();
+        for (const auto &d : costs) {
+            vals.push_back(d(int(i)));
+        }
+        acc += std::accumulate(vals.begin(), vals.end(), 0);
+    });
+    const auto sum = ns_per_op(iters, [&](uint64_t i) {
+        acc += invoke_reduce(cf, cl, reduce_sum<int>{}, int(i));
+    });
+    const auto any_loop = ns_per_op(iters, [&](uint64_t i) {
+        vals.clear();
+        for (const auto &d : handles) {
+            vals.push_back(d(int(i % count)));
+        }
+        acc += std::find(vals.begin(), vals.end(), 1) != vals.end();
+    });
+    const auto any = ns_per_op(iters, [&](uint64_t i) {
+        acc += invoke_reduce(hf, hl, reduce_any{}, int(i % count));
+    });
+
+    keep(acc);
+
+    printf("%lu handlers (ns per multicast)\n", count);
+    report("  sum: collect + accumulate", collect);
+    report("  sum: invoke_reduce", sum);
+    report("  any: collect + find", any_loop);
+    report("  any: invoke_reduce (short circuit)", any);
+}
@@ -0,0 +1,195 @@
+#include "delegate.h"
+#include "shmqueue.h"
+#include "bench.h"
+
+#include <sys/wait.h>
+
+static constexpr uint64_t pings = 100000;
+static constexpr uint64_t calls = 20000000;
+static constexpr uint64_t spin_limit = 256;
+
+struct message {
+    uint64_t seq;
+    uint64_t stamp;
+};
+
+// Both sides poll and only fall back to sleeping on the queue's
+// doorbells after spin_limit empty polls, so the benchmark also works
+// when the two processes share a core.
+
+template<class... Args, class... V>
+static void send(shm_queue &q, call_id<Args...> id, const V&... vals)
+{
+    for (uint64_t spins = 0; !q.push(id, vals...);) {
+        q.notify_data();
+        if (++spins % spin_limit == 0) {
+            q.wait_space();
+        }
+    }
+}
+
+template<class Done>
+static void receive(shm_queue &q, const call_registry &reg, Done done)
+{
+    for (uint64_t spins = 0; !done();) {
+        if (q.drain(reg) != 0) {
+            q.notify_space();
+            spins = 0;
+        }
+        else if (++spins % spin_limit == 0) {
+            q.wait_data();
+        }
+    }
+}
+
+// Both processes build the same registry before forking, so the ids
+// match; each process only ever invokes its own side's handlers.
+
+struct peer {
+    shm_queue *resp;
+    call_id<const message &> pong_id;
+    call_id<uint64_t> done_id;
+    uint64_t last_pong;
+    uint64_t sum;
+    bool quit;
+    bool finished;
+
+    // child side
+
+    void ping(const message &m)
+    {
+        send(*resp, pong_id, m);
+        resp->notify_data();
+    }
+
+    void work(uint64_t a, uint64_t b)
+    { sum += a * b; }
+
+    void flush()
+    {
+        send(*resp, done_id, sum);
+        resp->notify_data();
+    }
+
+    void stop()
+    { quit = true; }
+
+    // parent side
+
+    void pong(const message &m)
+    { last_pong = m.seq; }
+
+    void done(uint64_t total)
+    {
+        sum = total;
+        finished = true;
+    }
+};
+
+// A peer that rewrites the head index far past the tail must not make
+// drain() walk the ring more than once.
+
+struct tally {
+    void hit(uint64_t)
+    { n++; }
+
+    uint64_t n;
+};
+
+static bool bounds_forged_head()
+{
+    auto q = shm_queue::create(8);
+
+    tally t{};
+    call_registry reg(1);
+    const auto id = reg.add(delegate(&tally::hit, &t));
+
+    if (!q.push(id, uint64_t{1})) {
+        return false;
+    }
+
+    auto seg = mmap(nullptr, 64, PROT_READ | PROT_WRITE, MAP_SHARED, q.fd(), 0);
+    if (seg == MAP_FAILED) {
+        return false;
+    }
+
+    static_cast<std::atomic<uint64_t> *>(seg)->store(1000);
+    munmap(seg, 64);
+
+    const auto calls = q.drain(reg);
+    if (calls > 8) {
+        printf("shm queue: drained %lu calls from an 8 slot ring\n", calls);
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    if (!bounds_forged_head()) {
+        return 1;
+    }
+
+    auto req = shm_queue::create(4096);
+    auto resp = shm_queue::create(4096);
+
+    peer st{};
+    st.resp = &resp;
+
+    call_registry reg(8);
+
+    const auto ping_id = reg.add(delegate(&peer::ping, &st));
+    const auto work_id = reg.add(delegate(&peer::work, &st));
+    const auto flush_id = reg.add(delegate(&peer::flush, &st));
+    const auto stop_id = reg.add(delegate(&peer::stop, &st));
+    st.pong_id = reg.add(delegate(&peer::pong, &st));
+    st.done_id = reg.add(delegate(&peer::done, &st));
+
+    const uint8_t junk[call_registry::payload_size]{};
+    if (reg.invoke(reg.size(), junk) || reg.invoke(~0u, junk)) {
+        printf("call_registry: invoked an unregistered id\n");
+        return 1;
+    }
+
+    const auto pid = fork();
+    if (pid == 0) {
+        receive(req, reg, [&] { return st.quit; });
+        _exit(0);
+    }
+
+    // Latency: one call there and one back, one at a time
+
+    st.last_pong = ~0UL;
+    const auto rtt = ns_per_op(pings, [&](uint64_t i) {
+        send(req, ping_id, message{i, 0});
+        req.notify_data();
+        receive(resp, reg, [&] { return st.last_pong == i; });
+    });
+
+    // Throughput: stream calls as fast as the consumer takes them
+
+    uint64_t expected = 0;
+    const auto per_call = ns_per_op(calls, [&](uint64_t i) {
+        send(req, work_id, i, uint64_t{3});
+        expected += i * 3;
+    });
+
+    send(req, flush_id);
+    req.notify_data();
+    receive(resp, reg, [&] { return st.finished; });
+
+    send(req, stop_id);
+    req.notify_data();
+    waitpid(pid, nullptr, 0);
+
+    if (st.sum != expected) {
+        printf("shm queue: consumer saw %lu, expected %lu\n", st.sum, expected);
+        return 1;
+    }
+
+    printf("two processes, shared memory ring\n");
+    report("  one-way latency (rtt / 2)", rtt / 2);
+    report("  streaming cost per call", per_call);
+    printf("  %-38s %10.2f M calls/s\n", "throughput", 1e3 / per_call);
+}
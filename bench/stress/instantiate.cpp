@@ -0,0 +1,2 @@
+#include "stress.h"
+#include "instantiate.h"
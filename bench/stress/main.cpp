@@ -0,0 +1,13 @@
+#include <cstdio>
+
+long run_0();
+long run_1();
+long run_2();
+long run_3();
+
+static_assert(STRESS_TUS == 4, "main.cpp calls four translation units");
+
+int main()
+{
+    printf("%ld\n", run_0() + run_1() + run_2() + run_3());
+}
@@ -0,0 +1,34 @@
+# Prints, for every stress target, the summed compile time of its
+# translation units, the text size of its objects and of the linked
+# program, and the number of weak (template and inline) symbols its
+# objects define, i.e. instantiations compiled and emitted.
+
+foreach(target ${TARGETS})
+    file(GLOB_RECURSE objects ${DIR}/CMakeFiles/${target}.dir/*.o)
+
+    set(text 0)
+    set(weak 0)
+
+    foreach(obj ${objects})
+        execute_process(COMMAND ${SIZE} ${obj} OUTPUT_VARIABLE out)
+        string(REGEX MATCH "\n *([0-9]+)" _ "${out}")
+        math(EXPR text "${text} + ${CMAKE_MATCH_1}")
+
+        execute_process(COMMAND ${NM} --defined-only ${obj} OUTPUT_VARIABLE out)
+        string(REGEX MATCHALL " [WV] " syms "${out}")
+        list(LENGTH syms n)
+        math(EXPR weak "${weak} + ${n}")
+    endforeach()
+
+    set(ms 0)
+    file(GLOB times ${LOGS}/ms/${target}/*)
+    foreach(f ${times})
+        file(READ ${f} t)
+        math(EXPR ms "${ms} + ${t}")
+    endforeach()
+
+    execute_process(COMMAND ${SIZE} ${DIR}/${target} OUTPUT_VARIABLE out)
+    string(REGEX MATCH "\n *([0-9]+)" _ "${out}")
+
+    message("${target}: ${ms} ms compile, objects ${text} B text, ${weak} weak symbols; program ${CMAKE_MATCH_1} B text")
+endforeach()
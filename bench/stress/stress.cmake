@@ -0,0 +1,92 @@
+# Compile-time and code-size stress targets
+#
+# Generates STRESS_SIGNATURES distinct delegate signatures, each bound
+# to a free function, a memfn and a const memfn, and builds them into
+# one program per implementation from STRESS_TUS translation units that
+# all use every signature. Compiles are timed by time.sh; the
+# stress_report target prints compile times, object sizes and the
+# number of emitted template and inline instantiations.
+#
+# stress_placement_extern builds the placement program with every
+# signature declared DELEGATE_EXTERN_TEMPLATE and instantiated once.
+#
+# The split static_delegate/member_delegate design in bfdelegate.h has
+# no variant: member_delegate does not compile for a member function
+# that takes arguments (the constructor static_casts between unrelated
+# member function pointer types) and has no const memfn constructor, so
+# it cannot bind the generated handlers.
+
+set(STRESS_SIGNATURES 1000 CACHE STRING "Number of generated delegate signatures")
+set(STRESS_TUS 4)
+
+set(gen ${CMAKE_BINARY_DIR}/stress)
+
+set(sigs "")
+set(each "#define STRESS_EACH(X)")
+set(externs "")
+set(instances "")
+
+math(EXPR last "${STRESS_SIGNATURES} - 1")
+foreach(n RANGE ${last})
+    string(APPEND sigs
+        "struct arg_${n} { int v; };\n"
+        "struct handler_${n} {\n"
+        "    int on(arg_${n} a) { return a.v + v; }\n"
+        "    int peek(arg_${n} a) const { return a.v - v; }\n"
+        "    int v;\n"
+        "};\n"
+        "inline int fn_${n}(arg_${n} a) { return a.v * 2; }\n")
+    string(APPEND each " X(${n})")
+    string(APPEND externs "DELEGATE_EXTERN_TEMPLATE(int, arg_${n});\n")
+    string(APPEND instances "DELEGATE_INSTANTIATE(int, arg_${n});\n")
+endforeach()
+
+file(WRITE ${gen}/sigs.h.tmp "${sigs}\n${each}\n")
+file(WRITE ${gen}/extern.h.tmp "${externs}")
+file(WRITE ${gen}/instantiate.h.tmp "${instances}")
+
+foreach(f sigs.h extern.h instantiate.h)
+    configure_file(${gen}/${f}.tmp ${gen}/${f} COPYONLY)
+endforeach()
+
+set(tus "")
+math(EXPR last_tu "${STRESS_TUS} - 1")
+foreach(tu RANGE ${last_tu})
+    configure_file(${PROJECT_SOURCE_DIR}/bench/stress/tu.cpp.in ${gen}/tu_${tu}.cpp @ONLY)
+    list(APPEND tus ${gen}/tu_${tu}.cpp)
+endforeach()
+
+function(add_stress name impl)
+    add_executable(stress_${name} EXCLUDE_FROM_ALL)
+
+    target_sources(stress_${name} PRIVATE ${tus} ${PROJECT_SOURCE_DIR}/bench/stress/main.cpp)
+    target_compile_features(stress_${name} PRIVATE cxx_std_17)
+    target_compile_definitions(stress_${name} PRIVATE STRESS_IMPL_${impl} STRESS_TUS=${STRESS_TUS} ${ARGN})
+    target_include_directories(stress_${name} PRIVATE ${PROJECT_SOURCE_DIR}/${impl})
+    target_include_directories(stress_${name} PRIVATE ${PROJECT_SOURCE_DIR}/bench/stress ${gen})
+
+    set_property(TARGET stress_${name} PROPERTY RULE_LAUNCH_COMPILE
+        "${PROJECT_SOURCE_DIR}/bench/stress/time.sh ${gen}/ms/stress_${name}")
+    list(APPEND STRESS_TARGETS stress_${name})
+    set(STRESS_TARGETS ${STRESS_TARGETS} PARENT_SCOPE)
+endfunction()
+
+set(STRESS_TARGETS "")
+
+add_stress(placement placement)
+add_stress(placement_extern placement STRESS_EXTERN)
+add_stress(policy policy)
+add_stress(inheritance inheritance)
+add_stress(stdfunc stdfunc)
+
+target_sources(stress_placement_extern PRIVATE ${PROJECT_SOURCE_DIR}/bench/stress/instantiate.cpp)
+
+find_program(STRESS_SIZE size)
+
+add_custom_target(stress_report
+    COMMAND ${CMAKE_COMMAND}
+        -DNM=${CMAKE_NM} -DSIZE=${STRESS_SIZE} -DDIR=${CMAKE_BINARY_DIR} -DLOGS=${gen}
+        "-DTARGETS=${STRESS_TARGETS}"
+        -P ${PROJECT_SOURCE_DIR}/bench/stress/report.cmake
+    DEPENDS ${STRESS_TARGETS}
+    VERBATIM)
@@ -0,0 +1,51 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include "delegate.h"
+#include "sigs.h"
+
+#include <utility>
+
+#if defined(STRESS_IMPL_inheritance)
+
+#define STRESS_BIND(n)                                                        \
+    {                                                                         \
+        static handler_##n h{n};                                              \
+        static_delegate f(&fn_##n);                                           \
+        member_delegate m(&handler_##n::on, &h);                              \
+        member_delegate c(&handler_##n::peek, &h);                            \
+        const delegate<int, arg_##n> *ds[] = {&f, &m, &c};                    \
+        for (auto d : ds) {                                                   \
+            acc += (*d)(arg_##n{1});                                          \
+        }                                                                     \
+    }
+
+#elif defined(STRESS_IMPL_stdfunc)
+
+#define STRESS_BIND(n)                                                        \
+    {                                                                         \
+        static handler_##n h{n};                                              \
+        delegate f(&fn_##n);                                                  \
+        delegate m(&handler_##n::on, &h);                                     \
+        delegate c(&handler_##n::peek, &h);                                   \
+        acc += f(arg_##n{1}) + m(arg_##n{1}) + c(arg_##n{1});                 \
+    }
+
+#else
+
+#ifdef STRESS_EXTERN
+#include "extern.h"
+#endif
+
+#define STRESS_BIND(n)                                                        \
+    {                                                                         \
+        static handler_##n h{n};                                              \
+        delegate f(&fn_##n);                                                  \
+        delegate m(&handler_##n::on, &h);                                     \
+        delegate c(&handler_##n::peek, &std::as_const(h));                    \
+        acc += f(arg_##n{1}) + m(arg_##n{1}) + c(arg_##n{1});                 \
+    }
+
+#endif
+
+#endif
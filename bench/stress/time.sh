@@ -0,0 +1,24 @@
+#!/bin/sh
+# Compiler launcher: time.sh <log dir> <compile command...>
+#
+# Runs the command and writes its wall time in milliseconds to
+# <log dir>/<object name>.
+
+log=$1
+shift
+
+obj=
+prev=
+for arg in "$@"; do
+    if [ "$prev" = "-o" ]; then
+        obj=$(basename "$arg")
+    fi
+    prev=$arg
+done
+
+start=$(date +%s%N)
+"$@" || exit
+stop=$(date +%s%N)
+
+mkdir -p "$log"
+echo $(( (stop - start) / 1000000 )) > "$log/$obj"
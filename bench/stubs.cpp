@@ -0,0 +1,85 @@
+#include "delegate.h"
+#include "bench.h"
+
+#include <utility>
+#include <vector>
+
+static constexpr size_t classes = 1024;
+static constexpr uint64_t iters = 10000000;
+
+extern "C" char __executable_start;
+extern "C" char etext;
+
+/// Many distinct handler classes, as in a program with hundreds of
+/// event sinks
+///
+template<size_t N>
+struct handler {
+    int on(int n) { return n + val; }
+    int peek(int n) const { return n - val; }
+    int val;
+};
+
+template<size_t N>
+static handler<N> &instance()
+{
+    static handler<N> h{int(N)};
+    return h;
+}
+
+template<size_t... N>
+static void bind_all(std::vector<delegate<int, int>> &ds, std::index_sequence<N...>)
+{
+    ((N % 2 ? ds.emplace_back(&handler<N>::on, &instance<N>())
+            : ds.emplace_back(&handler<N>::peek, &std::as_const(instance<N>()))), ...);
+}
+
+int main()
+{
+    std::vector<delegate<int, int>> ds;
+    ds.reserve(classes);
+    bind_all(ds, std::make_index_sequence<classes>{});
+
+    auto copies = ds;
+
+    int expected = 0;
+    for (size_t i = 0; i < classes; i++) {
+        expected += i % 2 ? 1 + int(i) : 1 - int(i);
+    }
+
+    int acc = 0;
+    for (const auto &d : copies) {
+        acc += d(1);
+    }
+
+    if (acc != expected) {
+        printf("result mismatch\n");
+        return 1;
+    }
+
+    auto misses = cache_misses::l1i();
+    misses.start();
+
+    const auto ns = ns_per_op(iters, [&](uint64_t i) {
+        acc += ds[i % classes](int(i));
+    });
+
+    const auto l1i = misses.count();
+    keep(acc);
+
+#ifdef DELEGATE_PER_CLASS_STUBS
+    printf("per-class stubs (%zu handler classes)\n", classes);
+#else
+    printf("shared stubs (%zu handler classes)\n", classes);
+#endif
+
+    report("call, round robin over classes", ns);
+    printf("%-40s %10zu bytes\n", "text size", size_t(&etext - &__executable_start));
+
+    if (misses.valid()) {
+        printf("%-40s %10.4f per call\n", "L1i misses", double(l1i) / iters);
+    }
+    else {
+        printf("L1i misses: perf events not available\n");
+    }
+}
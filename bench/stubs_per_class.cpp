@@ -0,0 +1,2 @@
+#define DELEGATE_PER_CLASS_STUBS
+#include "stubs.cpp"
@@ -0,0 +1,285 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file arena.h
+///
+
+#ifndef BFARENA_H
+#define BFARENA_H
+
+#include "delegate.h"
+
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <sys/mman.h>
+
+/// arena
+///
+/// A bump allocator for objects that all die together, such as the
+/// callbacks built while handling one request. Memory comes in chunks
+/// that are kept across reset(), so a steady state workload never
+/// maps memory again.
+///
+/// Objects made with create() that are not trivially destructible are
+/// put on a destructor list, which reset() runs newest first. Trivially
+/// destructible objects cost nothing at reset.
+///
+/// With pages::huge the chunks are 2 MiB huge pages (MAP_HUGETLB), or,
+/// if none are reserved, normal mappings advised to use transparent
+/// huge pages.
+///
+class arena
+{
+public:
+    enum class pages
+    {
+        normal,
+        huge
+    };
+
+    explicit arena(size_t chunk_size = 64 * 1024, pages p = pages::normal) :
+        m_chunk_size{chunk_size},
+        m_pages{p}
+    {}
+
+   ~arena()
+    {
+        reset();
+
+        while (m_head != nullptr) {
+            const auto next = m_head->next;
+            munmap(m_head, m_head->size);
+            m_head = next;
+        }
+    }
+
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+
+    /// Allocate
+    ///
+    /// Returns size bytes aligned to align (a power of two).
+    ///
+    void *allocate(size_t size, size_t align)
+    {
+        auto p = (m_ptr + align - 1) & ~(uintptr_t(align) - 1);
+
+        if (m_cur == nullptr || p + size > m_end) {
+            next_chunk(size + align);
+            p = (m_ptr + align - 1) & ~(uintptr_t(align) - 1);
+        }
+
+        m_ptr = p + size;
+        return reinterpret_cast<void *>(p);
+    }
+
+    /// Create
+    ///
+    /// Constructs a T in the arena. It is destroyed by reset() unless it
+    /// is trivially destructible.
+    ///
+    template<class T, class... A>
+    T &create(A&&... args)
+    {
+        if constexpr (std::is_trivially_destructible_v<T>) {
+            return create_untracked<T>(std::forward<A>(args)...);
+        }
+        else {
+            auto d = static_cast<dtor *>(allocate(sizeof(dtor), alignof(dtor)));
+            auto &obj = create_untracked<T>(std::forward<A>(args)...);
+
+            *d = {&s_destroy<T>, &obj, m_dtors};
+            m_dtors = d;
+
+            return obj;
+        }
+    }
+
+    /// Create untracked
+    ///
+    /// Constructs a T in the arena that reset() will not destroy. Use it
+    /// for objects whose destructor has no effect worth running, e.g. a
+    /// delegate holding a trivially destructible callable.
+    ///
+    template<class T, class... A>
+    T &create_untracked(A&&... args)
+    { return *new (allocate(sizeof(T), alignof(T))) T(std::forward<A>(args)...); }
+
+    /// Reset
+    ///
+    /// Destroys the tracked objects and makes all memory free again.
+    ///
+    void reset() noexcept
+    {
+        for (auto d = m_dtors; d != nullptr; d = d->next) {
+            d->fn(d->obj);
+        }
+
+        m_dtors = nullptr;
+        m_cur = nullptr;
+        m_ptr = 0;
+        m_end = 0;
+    }
+
+    /// True if the chunks are backed by reserved huge pages
+    ///
+    bool hugetlb() const noexcept
+    { return m_hugetlb; }
+
+private:
+    static constexpr size_t s_huge_page = 2 * 1024 * 1024;
+
+    struct chunk
+    {
+        chunk *next;
+        size_t size;
+    };
+
+    struct dtor
+    {
+        void (*fn)(void *obj);
+        void *obj;
+        dtor *next;
+    };
+
+    template<class T>
+    static void s_destroy(void *obj)
+    { static_cast<T *>(obj)->~T(); }
+
+    /// Moves to the next chunk with room for size bytes, reusing chunks
+    /// kept from before the last reset() and mapping one if needed.
+    ///
+    void next_chunk(size_t size)
+    {
+        auto next = m_cur == nullptr ? m_head : m_cur->next;
+
+        if (next == nullptr || next->size - sizeof(chunk) < size) {
+            next = map(std::max(m_chunk_size, size + sizeof(chunk)));
+
+            if (m_cur == nullptr) {
+                next->next = m_head;
+                m_head = next;
+            }
+            else {
+                next->next = m_cur->next;
+                m_cur->next = next;
+            }
+        }
+
+        m_cur = next;
+        m_ptr = reinterpret_cast<uintptr_t>(next + 1);
+        m_end = reinterpret_cast<uintptr_t>(next) + next->size;
+    }
+
+    chunk *map(size_t size)
+    {
+        void *ptr = MAP_FAILED;
+
+        if (m_pages == pages::huge) {
+            size = (size + s_huge_page - 1) / s_huge_page * s_huge_page;
+
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+            m_hugetlb = ptr != MAP_FAILED;
+        }
+
+        if (ptr == MAP_FAILED) {
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (ptr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+
+            if (m_pages == pages::huge) {
+                madvise(ptr, size, MADV_HUGEPAGE);
+            }
+        }
+
+        return new (ptr) chunk{nullptr, size};
+    }
+
+    size_t m_chunk_size;
+    pages m_pages;
+    bool m_hugetlb{};
+
+    chunk *m_head{};
+    chunk *m_cur{};
+    uintptr_t m_ptr{};
+    uintptr_t m_end{};
+    dtor *m_dtors{};
+};
+
+/// arena ptr
+///
+/// The callable a delegate stores for a callable that lives in an arena.
+/// It is one pointer and trivially destructible, so the delegate needs
+/// no destruction either.
+///
+template<class F>
+class arena_ptr
+{
+public:
+    explicit arena_ptr(F *fn) noexcept :
+        m_fn{fn}
+    {}
+
+    template<class... A>
+    decltype(auto) operator()(A&&... args) const
+    { return (*m_fn)(std::forward<A>(args)...); }
+
+private:
+    F *m_fn;
+};
+
+/// Make delegate
+///
+/// Creates a delegate of type D for fn in a. A callable that fits in
+/// D::state_type is stored inline; a larger one is bump-allocated from the
+/// arena and the delegate points to it. Nothing is left for reset() to
+/// destroy unless fn itself is not trivially destructible.
+///
+template<class D, class F>
+D &make_delegate(arena &a, F &&fn)
+{
+    using T = std::decay_t<F>;
+
+    if constexpr (can_emplace<T, typename D::state_type>()) {
+        if constexpr (std::is_trivially_destructible_v<T>) {
+            return a.create_untracked<D>(std::in_place_type<T>, std::forward<F>(fn));
+        }
+        else {
+            return a.create<D>(std::in_place_type<T>, std::forward<F>(fn));
+        }
+    }
+    else {
+        auto &obj = a.create<T>(std::forward<F>(fn));
+        return a.create_untracked<D>(std::in_place_type<arena_ptr<T>>, &obj);
+    }
+}
+
+#endif
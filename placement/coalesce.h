@@ -0,0 +1,190 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file coalesce.h
+///
+
+#ifndef BFCOALESCE_H
+#define BFCOALESCE_H
+
+#include "delegate.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+/// coalescing queue
+///
+/// Defers calls to delegates until flush() and collapses repeated posts
+/// to the same target into one call. Targets are compared with
+/// delegate::same_target, i.e. by stub and bound object, so only
+/// function pointers and memfn/object pairs coalesce; other callables
+/// are queued once per post.
+///
+/// A repeated post replaces the pending arguments, or, if a merge
+/// delegate was given, calls merge(pending, latest) to combine them.
+/// Calls are made in the order their targets were first posted.
+///
+/// Handlers may post while being flushed; those posts are queued for
+/// the next flush. The queue is not thread safe.
+///
+template<class... Args>
+class coalescing_queue
+{
+public:
+    using handler_t = delegate<void, Args...>;
+    using args_t = std::tuple<std::decay_t<Args>...>;
+    using merge_t = delegate<void, args_t &, const args_t &>;
+
+    coalescing_queue() = default;
+
+    explicit coalescing_queue(merge_t merge) :
+        m_merge{std::move(merge)}
+    {}
+
+    /// Post
+    ///
+    /// Queues a call to fn with args, or folds args into the call already
+    /// queued for fn's target.
+    ///
+    void post(const handler_t &fn, Args... args)
+    {
+        m_posted++;
+
+        const auto hash = fn.target_hash();
+        auto i = hash & (m_index.size() - 1);
+
+        for (;; i = (i + 1) & (m_index.size() - 1)) {
+            const auto &s = m_index[i];
+
+            if (s.gen != m_gen) {
+                break;
+            }
+
+            auto &e = m_entries[s.entry];
+            if (e.hash == hash && e.fn.same_target(fn)) {
+                if (m_merge) {
+                    m_merge(e.args, args_t{args...});
+                }
+                else {
+                    e.args = args_t{args...};
+                }
+                return;
+            }
+        }
+
+        m_index[i] = {m_gen, static_cast<uint32_t>(m_entries.size())};
+        m_entries.push_back({fn, args_t{args...}, hash});
+
+        if (m_entries.size() * 2 > m_index.size()) {
+            grow();
+        }
+    }
+
+    /// Flush
+    ///
+    /// Makes the queued calls and returns how many there were.
+    ///
+    size_t flush()
+    {
+        m_ready.swap(m_entries);
+
+        if (++m_gen == 0) {
+            std::fill(m_index.begin(), m_index.end(), slot{});
+            m_gen = 1;
+        }
+
+        for (auto &e : m_ready) {
+            std::apply([&](auto &... a) {
+                e.fn(static_cast<Args>(a)...);
+            }, e.args);
+        }
+
+        const auto n = m_ready.size();
+
+        m_invoked += n;
+        m_ready.clear();
+
+        return n;
+    }
+
+    /// The number of calls waiting for the next flush
+    ///
+    size_t size() const noexcept
+    { return m_entries.size(); }
+
+    uint64_t posted() const noexcept
+    { return m_posted; }
+
+    uint64_t invoked() const noexcept
+    { return m_invoked; }
+
+    /// Coalesce ratio
+    ///
+    /// Posts per call made so far; 1.0 means nothing was coalesced.
+    ///
+    double coalesce_ratio() const noexcept
+    { return m_invoked ? double(m_posted) / double(m_invoked) : 1.0; }
+
+private:
+    struct entry
+    {
+        handler_t fn;
+        args_t args;
+        size_t hash;
+    };
+
+    struct slot
+    {
+        uint32_t gen;
+        uint32_t entry;
+    };
+
+    void grow()
+    {
+        m_index.assign(m_index.size() * 2, slot{});
+
+        for (size_t e = 0; e < m_entries.size(); e++) {
+            auto i = m_entries[e].hash & (m_index.size() - 1);
+
+            while (m_index[i].gen == m_gen) {
+                i = (i + 1) & (m_index.size() - 1);
+            }
+
+            m_index[i] = {m_gen, static_cast<uint32_t>(e)};
+        }
+    }
+
+    merge_t m_merge;
+
+    std::vector<entry> m_entries;
+    std::vector<entry> m_ready;
+    std::vector<slot> m_index = std::vector<slot>(64);
+
+    uint32_t m_gen{1};
+    uint64_t m_posted{};
+    uint64_t m_invoked{};
+};
+
+#endif
@@ -0,0 +1,244 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file compact.h
+///
+
+#ifndef BFCOMPACT_H
+#define BFCOMPACT_H
+
+#include "delegate.h"
+
+/// compact state
+///
+/// The same 24 bytes of callable storage as state_t, but only pointer
+/// aligned, so that a compact_delegate fits in 32 bytes.
+///
+using compact_state_t = state<24, 8>;
+
+/// stub
+///
+/// The one pointer a compact_delegate keeps besides its state. The call
+/// function comes first, so invoking only touches the first word of the
+/// stub; copy, move and destroy are reached through it and are never
+/// loaded on the hot path. There is one stub per callable type, so stubs
+/// stay cache resident no matter how many delegates refer to them.
+///
+template<class Ret, class... Args>
+struct stub
+{
+    Ret (&call)(const compact_state_t &state, Args&&... args);
+    const basic_vtable<compact_state_t> &vtbl;
+
+    template<class F>
+    static const stub &init() noexcept
+    {
+        static const stub self = {
+            .call = s_call<F>,
+            .vtbl = basic_vtable<compact_state_t>::init<F>()
+        };
+
+        return self;
+    }
+
+private:
+    template<class F>
+    static Ret s_call(const compact_state_t &state, Args&&... args)
+    {
+        static_assert(std::is_invocable_r_v<Ret, F, Args...>);
+        return get_state<F>(state)(std::forward<Args>(args)...);
+    }
+};
+
+/// compact delegate
+///
+/// A delegate with the same constructors as delegate, laid out so that
+/// the state and the stub pointer share half a cache line. A delegate
+/// is 64 bytes because of state_t's alignment and the separate vtable
+/// pointer; a compact_delegate is 32, so arrays of them load half as
+/// many bytes per dispatch, and aligning to 32 keeps each one within a
+/// single cache line.
+///
+template<class Ret, class... Args>
+class alignas(32) compact_delegate
+{
+public:
+    /// The state a callable must fit in to be stored inline
+    ///
+    using state_type = compact_state_t;
+
+    /// Empty (see delegate)
+    ///
+    compact_delegate() noexcept :
+        m_stub{&stub<Ret, Args...>::template init<empty_target<Ret>>()}
+    {}
+
+    /// Raw function pointer
+    ///
+    compact_delegate(Ret(*fn)(Args...)) :
+        compact_delegate(std::in_place_type<decltype(fn)>, fn)
+    {}
+
+    /// Non-const memfn, non-const object
+    ///
+    template<class C>
+    compact_delegate(Ret(C::*memfn)(Args...), C *obj) :
+        compact_delegate(std::in_place_type<member_t<C, decltype(memfn)>>, make_member(obj, memfn))
+    {}
+
+    /// Const memfn, non-const object
+    ///
+    template<class C, typename = std::enable_if<std::is_class_v<C>>>
+    compact_delegate(Ret(C::*memfn)(Args...) const, C *obj) :
+        compact_delegate(std::in_place_type<member_t<C, decltype(memfn)>>, make_member(obj, memfn))
+    {}
+
+    /// Const memfn, const object
+    ///
+    template<class C, typename = std::enable_if<std::is_class_v<C>>>
+    compact_delegate(Ret(C::*memfn)(Args...) const, const C *obj) :
+        compact_delegate(std::in_place_type<member_t<const C, decltype(memfn)>>, make_member(obj, memfn))
+    {}
+
+    /// In-place callable
+    ///
+    template<class F, class... A>
+    compact_delegate(std::in_place_type_t<F>, A&&... args)
+    {
+        m_stub = &stub<Ret, Args...>::template init<F>();
+        emplace_state<F>(m_state, std::forward<A>(args)...);
+    }
+
+    /// Copy constructor
+    ///
+    compact_delegate(const compact_delegate &other) :
+        m_stub{other.m_stub}
+    { m_stub->vtbl.copy(m_state, other.m_state); }
+
+    /// Move constructor
+    ///
+    compact_delegate(compact_delegate &&other) noexcept :
+        m_stub{other.m_stub}
+    { m_stub->vtbl.move(m_state, std::move(other.m_state)); }
+
+    /// Copy assignment (see delegate)
+    ///
+    compact_delegate &operator=(const compact_delegate &other)
+    {
+        if (this != &other) {
+            *this = compact_delegate(other);
+        }
+
+        return *this;
+    }
+
+    /// Move assignment
+    ///
+    compact_delegate &operator=(compact_delegate &&other) noexcept
+    {
+        if (this != &other) {
+            m_stub->vtbl.destroy(m_state);
+            m_stub = other.m_stub;
+            m_stub->vtbl.move(m_state, std::move(other.m_state));
+        }
+
+        return *this;
+    }
+
+    /// Destructor
+    ///
+   ~compact_delegate()
+   { m_stub->vtbl.destroy(m_state); }
+
+    /// Call operator
+    ///
+    Ret operator()(Args&&... args) const
+    { return m_stub->call(m_state, std::forward<Args>(args)...); }
+
+    /// Returns false if the delegate is empty
+    ///
+    explicit operator bool() const noexcept
+    { return m_stub != &stub<Ret, Args...>::template init<empty_target<Ret>>(); }
+
+    /// Prefetch
+    ///
+    /// Hints that the delegate is about to be called. The built-in
+    /// callables keep the bound object (or the function) in their first
+    /// word, so that is the address that gets prefetched.
+    ///
+    void prefetch() const noexcept
+    { __builtin_prefetch(get_state<const void *>(m_state)); }
+
+    /// Same target
+    ///
+    /// See delegate::same_target. The stub is per callable type, so it
+    /// stands in for both the call function and the vtable.
+    ///
+    bool same_target(const compact_delegate &other) const noexcept
+    {
+        if (this == &other) {
+            return true;
+        }
+
+        return m_stub == other.m_stub && m_stub->vtbl.id_size != 0 &&
+               std::memcmp(&m_state, &other.m_state, m_stub->vtbl.id_size) == 0;
+    }
+
+    /// Target hash
+    ///
+    size_t target_hash() const noexcept
+    { return hash_identity(reinterpret_cast<uintptr_t>(m_stub), &m_state, m_stub->vtbl.id_size); }
+
+    friend bool operator==(const compact_delegate &lhs, const compact_delegate &rhs) noexcept
+    { return lhs.same_target(rhs); }
+
+    friend bool operator!=(const compact_delegate &lhs, const compact_delegate &rhs) noexcept
+    { return !lhs.same_target(rhs); }
+
+private:
+    compact_state_t m_state;
+    const stub<Ret, Args...> *m_stub;
+};
+
+/// Class deduction guides
+
+template<class R, class... A>
+compact_delegate(R(A...)) -> compact_delegate<R, A...>;
+
+template<class C, class R, class... A>
+compact_delegate(R(C::*)(A...), C*) -> compact_delegate<R, A...>;
+
+template<class C, class R, class... A>
+compact_delegate(R(C::*)(A...) const, C*) -> compact_delegate<R, A...>;
+
+template<class C, class R, class... A>
+compact_delegate(R(C::*)(A...) const, const C*) -> compact_delegate<R, A...>;
+
+template<class Ret, class... Args>
+struct std::hash<compact_delegate<Ret, Args...>>
+{
+    size_t operator()(const compact_delegate<Ret, Args...> &d) const noexcept
+    { return d.target_hash(); }
+};
+
+#endif
@@ -0,0 +1,283 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file completion.h
+///
+
+#ifndef BFCOMPLETION_H
+#define BFCOMPLETION_H
+
+#include "delegate.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <vector>
+
+using task_t = delegate<void>;
+using executor_t = delegate<void, task_t>;
+
+/// completion
+///
+/// A one-shot result with a continuation. The value and the continuation
+/// are stored inline, so a completion never allocates; it lives in the
+/// object that issued the operation or comes from a completion_pool.
+///
+/// complete() and then() each publish their half with one atomic
+/// fetch_or on a two-bit state. Whichever comes second sees the other's
+/// bit and runs the continuation, so there is no lock and no
+/// allocation. The continuation runs inline in that thread, or is
+/// posted as a task to the executor given to then().
+///
+/// complete() and then() may each be called once until reset().
+///
+template<class T>
+class completion
+{
+public:
+    using continuation_t = delegate<void, T &>;
+
+    completion() = default;
+
+    completion(const completion &) = delete;
+    completion &operator=(const completion &) = delete;
+
+    /// Complete
+    ///
+    /// Stores the value and runs the continuation if there is one.
+    ///
+    template<class... A>
+    void complete(A&&... args)
+    {
+        m_value.emplace(std::forward<A>(args)...);
+
+        if (m_state.fetch_or(s_value, std::memory_order_acq_rel) & s_cont) {
+            run();
+        }
+    }
+
+    /// Then
+    ///
+    /// Sets the continuation and runs it if the value is already there.
+    ///
+    void then(const continuation_t &cont)
+    {
+        m_cont = cont;
+
+        if (m_state.fetch_or(s_cont, std::memory_order_acq_rel) & s_value) {
+            run();
+        }
+    }
+
+    /// Then (on an executor)
+    ///
+    /// As above, but the continuation is posted to exec as a task instead
+    /// of running in the thread that completes.
+    ///
+    void then(const continuation_t &cont, const executor_t &exec)
+    {
+        m_exec = exec;
+        then(cont);
+    }
+
+    /// Ready
+    ///
+    bool ready() const noexcept
+    { return m_state.load(std::memory_order_acquire) & s_value; }
+
+    /// Value, valid once ready() is true
+    ///
+    T &get() noexcept
+    { return *m_value; }
+
+    /// Reset
+    ///
+    /// Makes the completion reusable. Must not race with complete(),
+    /// then() or a continuation that is still running.
+    ///
+    void reset() noexcept
+    {
+        m_value.reset();
+        m_cont = continuation_t();
+        m_exec = executor_t();
+        m_state.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint32_t s_value = 1;
+    static constexpr uint32_t s_cont = 2;
+
+    void run()
+    {
+        if (m_exec) {
+            m_exec(task_t(&completion::invoke, this));
+        }
+        else {
+            m_cont(*m_value);
+        }
+    }
+
+    void invoke()
+    { m_cont(*m_value); }
+
+    std::atomic<uint32_t> m_state{};
+    std::optional<T> m_value;
+    continuation_t m_cont;
+    executor_t m_exec;
+};
+
+/// completion pool
+///
+/// A slab of completions allocated up front, with a stack of free ones
+/// so that acquire() and release() never allocate. The pool itself is
+/// not thread safe: acquire and release from the thread that owns it.
+/// The completions may be completed from any thread.
+///
+template<class T>
+class completion_pool
+{
+public:
+    explicit completion_pool(size_t size) :
+        m_slots{std::make_unique<completion<T>[]>(size)}
+    {
+        m_free.reserve(size);
+
+        for (size_t i = size; i > 0; i--) {
+            m_free.push_back(&m_slots[i - 1]);
+        }
+    }
+
+    /// Acquire
+    ///
+    /// Throws std::bad_alloc if every completion is in use.
+    ///
+    completion<T> &acquire()
+    {
+        if (m_free.empty()) {
+            throw std::bad_alloc();
+        }
+
+        auto c = m_free.back();
+        m_free.pop_back();
+
+        return *c;
+    }
+
+    /// Release
+    ///
+    /// Resets c and returns it to the pool.
+    ///
+    void release(completion<T> &c) noexcept
+    {
+        c.reset();
+        m_free.push_back(&c);
+    }
+
+private:
+    std::unique_ptr<completion<T>[]> m_slots;
+    std::vector<completion<T> *> m_free;
+};
+
+/// fan in
+///
+/// Runs a continuation once n operations have arrived. The count starts
+/// at n + 1 and then() arrives as well, so the continuation runs exactly
+/// once whether it is set before, between or after the arrivals.
+///
+class fan_in
+{
+public:
+    explicit fan_in(uint32_t n) noexcept :
+        m_count{n + 1}
+    {}
+
+    fan_in(const fan_in &) = delete;
+    fan_in &operator=(const fan_in &) = delete;
+
+    /// Arrive
+    ///
+    void arrive()
+    {
+        if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            run();
+        }
+    }
+
+    /// Attach
+    ///
+    /// Makes c arrive here when it completes.
+    ///
+    template<class T>
+    void attach(completion<T> &c)
+    { c.then(delegate(&fan_in::arrive_with<T>, this)); }
+
+    /// Then
+    ///
+    void then(const task_t &cont)
+    {
+        m_cont = cont;
+        arrive();
+    }
+
+    /// Then (on an executor)
+    ///
+    void then(const task_t &cont, const executor_t &exec)
+    {
+        m_exec = exec;
+        then(cont);
+    }
+
+    /// Reset
+    ///
+    /// Rearms for n arrivals. Must not race with arrivals.
+    ///
+    void reset(uint32_t n) noexcept
+    {
+        m_cont = task_t();
+        m_exec = executor_t();
+        m_count.store(n + 1, std::memory_order_relaxed);
+    }
+
+private:
+    template<class T>
+    void arrive_with(T &)
+    { arrive(); }
+
+    void run()
+    {
+        if (m_exec) {
+            m_exec(task_t(m_cont));
+        }
+        else {
+            m_cont();
+        }
+    }
+
+    std::atomic<uint32_t> m_count;
+    task_t m_cont;
+    executor_t m_exec;
+};
+
+#endif
@@ -0,0 +1,353 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file coro.h
+///
+
+#ifndef BFCORO_H
+#define BFCORO_H
+
+#if __cplusplus < 202002L
+#error "coro.h requires C++20"
+#endif
+
+#include "delegate.h"
+#include "completion.h"
+
+#include <array>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <vector>
+
+/// resume handle
+///
+/// The callable stored in a delegate<void> that resumes a coroutine. It
+/// is a single pointer, so it always fits inline.
+///
+class resume_handle
+{
+public:
+    explicit resume_handle(std::coroutine_handle<> handle) noexcept :
+        m_handle{handle}
+    {}
+
+    void operator()() const
+    { m_handle.resume(); }
+
+private:
+    std::coroutine_handle<> m_handle;
+};
+
+/// Returns a task that resumes handle
+///
+inline task_t resumer(std::coroutine_handle<> handle)
+{ return task_t(std::in_place_type<resume_handle>, handle); }
+
+/// resume via
+///
+/// An awaitable that suspends the coroutine and passes a task that
+/// resumes it to start. This adapts any callback API that accepts a
+/// delegate<void>: an executor, a timer, an I/O completion.
+///
+class resume_via
+{
+public:
+    explicit resume_via(executor_t start) :
+        m_start{std::move(start)}
+    {}
+
+    bool await_ready() const noexcept
+    { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    { m_start(resumer(handle)); }
+
+    void await_resume() const noexcept
+    {}
+
+private:
+    executor_t m_start;
+};
+
+/// completion awaiter
+///
+/// Awaits a completion<T> and yields its value. The continuation set on
+/// the completion is a delegate to this awaiter, which lives in the
+/// coroutine frame, so awaiting never allocates. If an executor is
+/// given, the coroutine is resumed through it.
+///
+template<class T>
+class completion_awaiter
+{
+public:
+    explicit completion_awaiter(completion<T> &c, const executor_t *exec = nullptr) noexcept :
+        m_completion{c},
+        m_exec{exec}
+    {}
+
+    bool await_ready() const noexcept
+    { return m_completion.ready(); }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_handle = handle;
+
+        if (m_exec != nullptr) {
+            m_completion.then(delegate(&completion_awaiter::resume, this), *m_exec);
+        }
+        else {
+            m_completion.then(delegate(&completion_awaiter::resume, this));
+        }
+    }
+
+    T &await_resume() const noexcept
+    { return m_completion.get(); }
+
+private:
+    void resume(T &)
+    { m_handle.resume(); }
+
+    completion<T> &m_completion;
+    const executor_t *m_exec;
+    std::coroutine_handle<> m_handle;
+};
+
+template<class T>
+completion_awaiter<T> operator co_await(completion<T> &c) noexcept
+{ return completion_awaiter<T>(c); }
+
+/// frame pool
+///
+/// Size-class free lists for coroutine frames. Each thread has its own
+/// lists, so allocating and freeing a frame is a pointer pop or push
+/// with no locking; frames freed by another thread join that thread's
+/// lists. Frames larger than the biggest class go to the global heap.
+///
+class frame_pool
+{
+public:
+    static void *allocate(size_t size)
+    {
+        const auto c = size_class(size);
+        if (c == s_classes) {
+            return ::operator new(size);
+        }
+
+        auto &l = lists();
+        if (auto n = l.free[c]) {
+            l.free[c] = n->next;
+            return n;
+        }
+
+        l.fresh++;
+        return ::operator new(s_min << c);
+    }
+
+    static void deallocate(void *ptr, size_t size) noexcept
+    {
+        const auto c = size_class(size);
+        if (c == s_classes) {
+            return ::operator delete(ptr);
+        }
+
+        auto &l = lists();
+        auto n = static_cast<node *>(ptr);
+
+        n->next = l.free[c];
+        l.free[c] = n;
+    }
+
+    /// The number of frames this thread took from the global heap
+    ///
+    static uint64_t fresh() noexcept
+    { return lists().fresh; }
+
+private:
+    static constexpr size_t s_min = 64;
+    static constexpr size_t s_classes = 6;
+
+    struct node
+    {
+        node *next;
+    };
+
+    struct thread_lists
+    {
+        ~thread_lists()
+        {
+            for (auto n : free) {
+                while (n != nullptr) {
+                    ::operator delete(std::exchange(n, n->next));
+                }
+            }
+        }
+
+        std::array<node *, s_classes> free{};
+        uint64_t fresh{};
+    };
+
+    static size_t size_class(size_t size) noexcept
+    {
+        size_t c = 0;
+        while (c < s_classes && (s_min << c) < size) {
+            c++;
+        }
+
+        return c;
+    }
+
+    static thread_lists &lists() noexcept
+    {
+        thread_local thread_lists s_lists;
+        return s_lists;
+    }
+};
+
+/// task
+///
+/// A fire-and-forget coroutine. It starts suspended and runs once it is
+/// spawned on a coro_executor; its frame comes from the frame_pool and
+/// is freed when the coroutine finishes. Exceptions escaping a task
+/// call std::terminate.
+///
+class task
+{
+public:
+    struct promise_type
+    {
+        task get_return_object() noexcept
+        { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        std::suspend_always initial_suspend() const noexcept
+        { return {}; }
+
+        std::suspend_never final_suspend() const noexcept
+        { return {}; }
+
+        void return_void() const noexcept
+        {}
+
+        void unhandled_exception() const noexcept
+        { std::terminate(); }
+
+        static void *operator new(size_t size)
+        { return frame_pool::allocate(size); }
+
+        static void operator delete(void *ptr, size_t size) noexcept
+        { frame_pool::deallocate(ptr, size); }
+    };
+
+    task(task &&other) noexcept :
+        m_handle{std::exchange(other.m_handle, nullptr)}
+    {}
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+    task &operator=(task &&) = delete;
+
+   ~task()
+    {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    /// Release
+    ///
+    /// Gives up ownership of the suspended coroutine.
+    ///
+    std::coroutine_handle<> release() noexcept
+    { return std::exchange(m_handle, nullptr); }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept :
+        m_handle{handle}
+    {}
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+/// coro executor
+///
+/// A run queue of delegate<void> tasks that drives coroutines and plain
+/// callbacks alike. Tasks posted while running are run in the same call
+/// to run(). The executor is not thread safe: post from the thread that
+/// runs it.
+///
+class coro_executor
+{
+public:
+    /// Post
+    ///
+    void post(task_t t)
+    { m_queue.push_back(std::move(t)); }
+
+    /// Spawn
+    ///
+    /// Queues t to start on the next run().
+    ///
+    void spawn(task &&t)
+    { post(resumer(t.release())); }
+
+    /// Schedule
+    ///
+    /// co_await schedule() suspends the coroutine and requeues it.
+    ///
+    resume_via schedule()
+    { return resume_via(executor()); }
+
+    /// The executor as a delegate, for completion::then and resume_via
+    ///
+    executor_t executor() noexcept
+    { return executor_t(&coro_executor::post, this); }
+
+    /// Run
+    ///
+    /// Runs tasks until the queue is empty and returns how many ran.
+    ///
+    size_t run()
+    {
+        size_t n = 0;
+
+        while (!m_queue.empty()) {
+            m_running.swap(m_queue);
+
+            for (auto &t : m_running) {
+                t();
+            }
+
+            n += m_running.size();
+            m_running.clear();
+        }
+
+        return n;
+    }
+
+private:
+    std::vector<task_t> m_queue;
+    std::vector<task_t> m_running;
+};
+
+#endif
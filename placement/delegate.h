@@ -26,10 +26,16 @@
 #ifndef BFDELEGATE_H
 #define BFDELEGATE_H
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <functional>
+#include <new>
+#include <stdexcept>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 
 /// state
 ///
@@ -54,57 +60,119 @@ using call_t = Ret(*)(const state_t&, Args&&...);
 ///
 /// They are used to reinterpret a piece of memory as a functor type F
 ///
-template<class F>
+template<class F, class S = state_t>
 static constexpr bool can_emplace()
 {
-    return (sizeof(F) <= sizeof(state_t)) &&
-           (alignof(state_t) % alignof(F) == 0);
+    return (sizeof(F) <= sizeof(S)) &&
+           (alignof(S) % alignof(F) == 0);
 }
 
-template<class F>
-static F &get_state(const state_t &state)
+template<class F, class S>
+static F &get_state(const S &state)
 { return (F &)(state); }
 
-template<class F>
-static void copy_state(state_t &state, const F &fn)
+template<class F, class S>
+static void copy_state(S &state, const F &fn)
 {
-    static_assert(can_emplace<F>());
+    static_assert(can_emplace<F, S>());
     new (&get_state<F>(state)) F(fn);
 }
 
-template<class F>
-static void move_state(state_t &state, F &&src)
+template<class F, class S>
+static void move_state(S &state, F &&src)
 {
-    static_assert(can_emplace<F>());
-    new (&get_state<F>(state)) F(src);
+    static_assert(can_emplace<F, S>());
+    new (&get_state<F>(state)) F(std::move(src));
+}
+
+template<class F, class S, class... A>
+static void emplace_state(S &state, A&&... args)
+{
+    static_assert(can_emplace<F, S>());
+    new (&get_state<F>(state)) F(std::forward<A>(args)...);
 }
 
 template<class F, class Ret, class... Args>
-static Ret call(const state_t &state, Args&&... args)
+Ret call(const state_t &state, Args&&... args)
 {
     static_assert(std::is_invocable_r_v<Ret, F, Args...>);
     return get_state<F>(state)(std::forward<Args>(args)...);
 }
 
+template<class C, class MemFn>
+class member;
+
+/// identity size
+///
+/// The number of leading state bytes that identify the target of a
+/// callable of type F, or 0 if F has no identity. Function pointers
+/// and member (an object address followed by a memfn, without padding)
+/// are identified by their bytes. Lambdas and bound arguments are not,
+/// since their bytes may include padding or owned resources.
+///
+template<class F>
+struct identity_size :
+    std::integral_constant<size_t, 0>
+{};
+
+template<class R, class... A>
+struct identity_size<R(*)(A...)> :
+    std::integral_constant<size_t, sizeof(R(*)(A...))>
+{};
+
+template<class C, class MemFn>
+struct identity_size<member<C, MemFn>> :
+    std::integral_constant<size_t,
+        sizeof(member<C, MemFn>) == sizeof(C *) + sizeof(MemFn) ?
+        sizeof(member<C, MemFn>) : 0>
+{};
+
+/// hash identity
+///
+/// Hashes a stub address and the first size bytes of a state.
+///
+static inline size_t hash_identity(uintptr_t stub, const void *state, size_t size) noexcept
+{
+    const auto bytes = static_cast<const uint8_t *>(state);
+    auto h = static_cast<uint64_t>(stub);
+
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, std::min(sizeof(word), size - i));
+
+        h = (h ^ word) * 0xff51afd7ed558ccd;
+        h ^= h >> 32;
+    }
+
+    return static_cast<size_t>(h);
+}
+
 /// vtable
 ///
 /// Each delegate has a vtable that contains functions to copy,
 /// move, and destroy a given type. It is used to implement
-/// the copy/move ctor/assignment ops of the delegate.
+/// the copy/move ctor/assignment ops of the delegate. id_size
+/// is the identity_size of the type, and trivial is true if the
+/// type can be relocated with memcpy.
 ///
-class vtable {
+template<class S = state_t>
+class basic_vtable {
 public:
-    void (&copy)(state_t &lhs, const state_t &rhs);
-    void (&move)(state_t &lhs, state_t &&rhs);
-    void (&destroy)(state_t &state);
+    void (&copy)(S &lhs, const S &rhs);
+    void (&move)(S &lhs, S &&rhs);
+    void (&destroy)(S &state);
+    size_t id_size;
+    bool trivial;
 
     template<class F>
-    static const vtable &init() noexcept
+    static const basic_vtable &init() noexcept
     {
-        static const vtable self = {
+        static const basic_vtable self = {
             .copy = s_copy<F>,
             .move = s_move<F>,
-            .destroy = s_destroy<F>
+            .destroy = s_destroy<F>,
+            .id_size = identity_size<F>::value,
+            .trivial = std::is_trivially_copyable_v<F>
         };
 
         return self;
@@ -115,24 +183,143 @@ private:
         class F,
         typename std::enable_if_t<std::is_copy_constructible_v<F>>* = nullptr
     >
-    static void s_copy(state_t &lhs, const state_t &rhs) noexcept
+    static void s_copy(S &lhs, const S &rhs) noexcept
     { copy_state<F>(lhs, get_state<F>(rhs)); }
 
+    /// Move-only callables cannot be copied, so copying a delegate that
+    /// holds one throws. Whether the callable is copyable is only known
+    /// at run time, once its type has been erased.
+    ///
+    template<
+        class F,
+        typename std::enable_if_t<!std::is_copy_constructible_v<F>>* = nullptr
+    >
+    static void s_copy(S &, const S &)
+    { throw std::logic_error("delegate: copying a move-only callable"); }
+
     template<
         class F,
         typename std::enable_if_t<std::is_move_constructible_v<F>>* = nullptr
     >
-    static void s_move(state_t &lhs, state_t &&rhs) noexcept
+    static void s_move(S &lhs, S &&rhs) noexcept
     { move_state<F>(lhs, std::move(get_state<F>(rhs))); }
 
     template<
         class F,
         typename std::enable_if_t<std::is_destructible_v<F>>* = nullptr
     >
-    static void s_destroy(state_t &state) noexcept
+    static void s_destroy(S &state) noexcept
     { get_state<F>(state).~F(); }
 };
 
+using vtable = basic_vtable<>;
+
+/// member
+///
+/// The callable stored for a member function bound to an object.
+///
+template<class C, class MemFn>
+class member
+{
+public:
+    member(C *obj, MemFn fn) noexcept :
+        m_obj{obj},
+        m_fn{fn}
+    {}
+
+    template<class... A>
+    decltype(auto) operator()(A&&... args) const
+    { return std::invoke(m_fn, m_obj, std::forward<A>(args)...); }
+
+private:
+    C *m_obj;
+    MemFn m_fn;
+};
+
+/// shared member stubs
+///
+/// On the Itanium C++ ABI every pointer to member function is the same
+/// pair of words (function or vtable offset, and this adjustment),
+/// whatever its class, and calling through one only applies the stored
+/// adjustment to the object pointer. So every memfn/object pair of one
+/// signature is stored as a member of one placeholder class, and all of
+/// them share one call stub and one vtable instead of getting a set per
+/// class, per constness and per constructor. Plain function pointers
+/// already share theirs.
+///
+/// member_t is the stored type and make_member builds it. Define
+/// DELEGATE_PER_CLASS_STUBS, or use another ABI, to get the per-class
+/// member types instead.
+///
+class generic_class
+{};
+
+template<class MemFn>
+struct generic_memfn;
+
+template<class R, class C, class... A>
+struct generic_memfn<R(C::*)(A...)>
+{ using type = R(generic_class::*)(A...); };
+
+template<class R, class C, class... A>
+struct generic_memfn<R(C::*)(A...) const>
+{ using type = R(generic_class::*)(A...); };
+
+#if defined(__GXX_ABI_VERSION) && !defined(DELEGATE_PER_CLASS_STUBS)
+
+template<class C, class MemFn>
+using member_t = member<generic_class, typename generic_memfn<MemFn>::type>;
+
+template<class C, class MemFn>
+static member_t<C, MemFn> make_member(C *obj, MemFn fn) noexcept
+{
+    return member_t<C, MemFn>(
+        reinterpret_cast<generic_class *>(const_cast<std::remove_const_t<C> *>(obj)),
+        reinterpret_cast<typename generic_memfn<MemFn>::type>(fn));
+}
+
+#else
+
+template<class C, class MemFn>
+using member_t = member<C, MemFn>;
+
+template<class C, class MemFn>
+static member_t<C, MemFn> make_member(C *obj, MemFn fn) noexcept
+{ return member_t<C, MemFn>(obj, fn); }
+
+#endif
+
+/// empty target
+///
+/// The callable held by a default-constructed delegate. Calling it does
+/// nothing and returns a value-initialized Ret, so an empty delegate
+/// can be called like any other: no null check on the call path, and
+/// its copy, move and destroy are no-ops like a function pointer's.
+///
+/// A Ret that cannot be value-initialized (a reference, or a type with
+/// no default constructor) has no such value, and calling an empty
+/// delegate then throws std::bad_function_call, as std::function does.
+///
+template<class Ret>
+class empty_target
+{
+public:
+    template<class... A>
+    Ret operator()(A&&...) const noexcept(std::is_void_v<Ret> || std::is_nothrow_default_constructible_v<Ret>)
+    {
+        if constexpr (s_returns) {
+            return Ret();
+        }
+        else {
+            throw std::bad_function_call();
+        }
+    }
+
+private:
+    static constexpr bool s_returns =
+        std::is_void_v<Ret> || std::is_default_constructible_v<Ret>;
+};
+
 /// delegate
 ///
 /// Wraps either a raw function pointer or a pointer-to-member-function
@@ -148,52 +335,73 @@ template<class Ret, class... Args>
 class delegate
 {
 public:
+    /// The state a callable must fit in to be stored inline
+    ///
+    using state_type = state_t;
+
+    /// Empty
+    ///
+    /// Holds an empty_target.
+    ///
+    delegate() noexcept :
+        m_call{&call<empty_target<Ret>, Ret, Args...>},
+        m_vtbl{&vtable::init<empty_target<Ret>>()}
+    {}
+
     /// Raw function pointer
     ///
-    delegate(Ret(*fn)(Args...))
-    {
-        m_call = &call<decltype(fn), Ret, Args...>;
-        m_vtbl = &vtable::init<decltype(fn)>();
-        copy_state(m_state, fn);
-    }
+    /// Defined out of line, like the memfn overload below, so that
+    /// DELEGATE_EXTERN_TEMPLATE keeps it and its stub out of every
+    /// translation unit but one.
+    ///
+    delegate(Ret(*fn)(Args...));
 
     /// Non-const memfn, non-const object
     ///
     template<class C>
-    delegate(Ret(C::*memfn)(Args...), C *obj)
-    {
-        auto fn = [memfn, obj](Args&&... args) -> decltype(auto)
-        { return std::invoke(memfn, obj, args...); };
-
-        m_call = &call<decltype(fn), Ret, Args...>;
-        m_vtbl = &vtable::init<decltype(fn)>();
-        copy_state(m_state, fn);
-    }
+    delegate(Ret(C::*memfn)(Args...), C *obj) :
+        delegate(make_member(obj, memfn))
+    {}
 
     /// Const memfn, non-const object
     ///
     template<class C, typename = std::enable_if<std::is_class_v<C>>>
-    delegate(Ret(C::*memfn)(Args...) const, C *obj)
-    {
-        auto fn = [memfn, obj](Args&&... args) -> decltype(auto)
-        { return std::invoke(memfn, obj, args...); };
-
-        m_call = &call<decltype(fn), Ret, Args...>;
-        m_vtbl = &vtable::init<decltype(fn)>();
-        copy_state(m_state, fn);
-    }
+    delegate(Ret(C::*memfn)(Args...) const, C *obj) :
+        delegate(make_member(obj, memfn))
+    {}
 
     /// Const memfn, const object
     ///
     template<class C, typename = std::enable_if<std::is_class_v<C>>>
-    delegate(Ret(C::*memfn)(Args...) const, const C *obj)
-    {
-        auto fn = [memfn, obj](Args&&... args) -> decltype(auto)
-        { return std::invoke(memfn, obj, args...); };
+    delegate(Ret(C::*memfn)(Args...) const, const C *obj) :
+        delegate(make_member(obj, memfn))
+    {}
 
-        m_call = &call<decltype(fn), Ret, Args...>;
-        m_vtbl = &vtable::init<decltype(fn)>();
-        copy_state(m_state, fn);
+    /// Memfn and object
+    ///
+    /// The memfn constructors build a member_t and land here. With
+    /// shared stubs that is the non-template overload for every class,
+    /// which is what lets DELEGATE_INSTANTIATE compile memfn delegates
+    /// once per program.
+    ///
+    explicit delegate(const member<generic_class, Ret(generic_class::*)(Args...)> &fn);
+
+    template<class C, class MemFn>
+    explicit delegate(const member<C, MemFn> &fn) :
+        delegate(std::in_place_type<member<C, MemFn>>, fn)
+    {}
+
+    /// In-place callable
+    ///
+    /// Constructs a callable of type F directly in the state from
+    /// args. F must fit in state_t.
+    ///
+    template<class F, class... A>
+    delegate(std::in_place_type_t<F>, A&&... args)
+    {
+        m_call = &call<F, Ret, Args...>;
+        m_vtbl = &vtable::init<F>();
+        emplace_state<F>(m_state, std::forward<A>(args)...);
     }
 
     /// Copy constructor
@@ -205,27 +413,41 @@ public:
 
     /// Move constructor
     ///
-    delegate(delegate &&other) :
+    /// noexcept so that containers move delegates when they grow rather
+    /// than copy them. A callable whose move constructor throws
+    /// terminates.
+    ///
+    delegate(delegate &&other) noexcept :
         m_call{other.m_call},
         m_vtbl{other.m_vtbl}
     { m_vtbl->move(m_state, std::move(other.m_state)); }
 
     /// Copy assignment
     ///
+    /// Copies before destroying the current callable, so a delegate
+    /// that fails to copy (see s_copy) is left unchanged.
+    ///
     delegate &operator=(const delegate &other)
     {
-        m_call = other.m_call;
-        m_vtbl = other.m_vtbl;
-        m_vtbl->copy(m_state, other.m_state);
+        if (this != &other) {
+            *this = delegate(other);
+        }
+
+        return *this;
     }
 
     /// Move assignment
     ///
-    delegate &operator=(delegate &&other)
+    delegate &operator=(delegate &&other) noexcept
     {
-        m_call = other.m_call;
-        m_vtbl = other.m_vtbl;
-        m_vtbl->move(m_state, std::move(other.m_state));
+        if (this != &other) {
+            m_vtbl->destroy(m_state);
+            m_call = other.m_call;
+            m_vtbl = other.m_vtbl;
+            m_vtbl->move(m_state, std::move(other.m_state));
+        }
+
+        return *this;
     }
 
     /// Destructor
@@ -233,17 +455,145 @@ public:
    ~delegate()
    { m_vtbl->destroy(m_state); }
 
+    /// Emplace
+    ///
+    /// Destroys the current callable and constructs a callable of type F
+    /// from args directly in its place, without a temporary delegate.
+    /// If constructing F throws, the delegate is left empty.
+    ///
+    template<class F, class... A>
+    void emplace(A&&... args)
+    {
+        m_vtbl->destroy(m_state);
+
+        if constexpr (!std::is_nothrow_constructible_v<F, A...>) {
+            m_call = &call<empty_target<Ret>, Ret, Args...>;
+            m_vtbl = &vtable::init<empty_target<Ret>>();
+        }
+
+        emplace_state<F>(m_state, std::forward<A>(args)...);
+        m_call = &call<F, Ret, Args...>;
+        m_vtbl = &vtable::init<F>();
+    }
+
+    /// Rebind (raw function pointer)
+    ///
+    void rebind(Ret(*fn)(Args...))
+    { emplace<decltype(fn)>(fn); }
+
+    /// Rebind (non-const memfn, non-const object)
+    ///
+    template<class C>
+    void rebind(Ret(C::*memfn)(Args...), C *obj)
+    { emplace<member_t<C, decltype(memfn)>>(make_member(obj, memfn)); }
+
+    /// Rebind (const memfn, non-const object)
+    ///
+    template<class C, typename = std::enable_if<std::is_class_v<C>>>
+    void rebind(Ret(C::*memfn)(Args...) const, C *obj)
+    { emplace<member_t<C, decltype(memfn)>>(make_member(obj, memfn)); }
+
+    /// Rebind (const memfn, const object)
+    ///
+    template<class C, typename = std::enable_if<std::is_class_v<C>>>
+    void rebind(Ret(C::*memfn)(Args...) const, const C *obj)
+    { emplace<member_t<const C, decltype(memfn)>>(make_member(obj, memfn)); }
+
     /// Call operator
     ///
     Ret operator()(Args&&... args) const
     { return m_call(m_state, std::forward<Args>(args)...); }
 
+    /// Returns false if the delegate is empty
+    ///
+    explicit operator bool() const noexcept
+    { return m_vtbl != &vtable::init<empty_target<Ret>>(); }
+
+    /// Prefetch
+    ///
+    /// Hints that the delegate is about to be called. The built-in
+    /// callables keep the bound object (or the function) in their first
+    /// word, so that is the address that gets prefetched.
+    ///
+    void prefetch() const noexcept
+    { __builtin_prefetch(get_state<const void *>(m_state)); }
+
+    /// Trivially relocatable
+    ///
+    /// True if the callable is trivially copyable, in which case the
+    /// delegate can be moved to new storage with memcpy and the old
+    /// storage simply dropped.
+    ///
+    bool trivially_relocatable() const noexcept
+    { return m_vtbl->trivial; }
+
+    /// Same target
+    ///
+    /// Returns true if both delegates call the same function on the same
+    /// object. Only function pointers and memfn/object pairs have an
+    /// identity; a delegate holding any other callable, including an
+    /// empty one, is only the same as itself.
+    ///
+    bool same_target(const delegate &other) const noexcept
+    {
+        if (this == &other) {
+            return true;
+        }
+
+        return m_call == other.m_call && m_vtbl == other.m_vtbl &&
+               m_vtbl->id_size != 0 &&
+               std::memcmp(&m_state, &other.m_state, m_vtbl->id_size) == 0;
+    }
+
+    /// Target hash
+    ///
+    /// A hash of the call stub and the identity bytes of the state,
+    /// consistent with same_target.
+    ///
+    size_t target_hash() const noexcept
+    { return hash_identity(reinterpret_cast<uintptr_t>(m_call), &m_state, m_vtbl->id_size); }
+
+    /// Equality
+    ///
+    /// Delegates are equal if they have the same target (see same_target).
+    ///
+    friend bool operator==(const delegate &lhs, const delegate &rhs) noexcept
+    { return lhs.same_target(rhs); }
+
+    friend bool operator!=(const delegate &lhs, const delegate &rhs) noexcept
+    { return !lhs.same_target(rhs); }
+
 private:
     state_t m_state;
     call_t<Ret, Args...> m_call;
     const vtable *m_vtbl;
 };
 
+template<class Ret, class... Args>
+delegate<Ret, Args...>::delegate(Ret(*fn)(Args...))
+{
+    m_call = &call<decltype(fn), Ret, Args...>;
+    m_vtbl = &vtable::init<decltype(fn)>();
+    copy_state(m_state, fn);
+}
+
+template<class Ret, class... Args>
+delegate<Ret, Args...>::delegate(const member<generic_class, Ret(generic_class::*)(Args...)> &fn) :
+    delegate(std::in_place_type<std::decay_t<decltype(fn)>>, fn)
+{}
+
+/// extern templates
+///
+/// DELEGATE_EXTERN_TEMPLATE(Ret, Args...) in a shared header tells every
+/// translation unit that delegate<Ret, Args...>, together with its
+/// function pointer and (with shared stubs) memfn call stubs and
+/// vtables, is compiled in one translation unit, the one that says
+/// DELEGATE_INSTANTIATE(Ret, Args...). Members defined in the class
+/// body are inline and are still compiled wherever they are used.
+///
+#define DELEGATE_EXTERN_TEMPLATE(...) extern template class delegate<__VA_ARGS__>
+#define DELEGATE_INSTANTIATE(...) template class delegate<__VA_ARGS__>
+
 /// Class deduction guides
 
 template<class R, class... A>
@@ -258,4 +608,255 @@ delegate(R(C::*)(A...) const, C*) -> delegate<R, A...>;
 template<class C, class R, class... A>
 delegate(R(C::*)(A...) const, const C*) -> delegate<R, A...>;
 
+/// Hashing, consistent with operator==
+
+template<class Ret, class... Args>
+struct std::hash<delegate<Ret, Args...>>
+{
+    size_t operator()(const delegate<Ret, Args...> &d) const noexcept
+    { return d.target_hash(); }
+};
+
+/// bound
+///
+/// The callable stored by bind_front. It holds the target and the
+/// leading arguments inline and appends the remaining arguments on
+/// each call.
+///
+template<class F, class... Bound>
+class bound
+{
+public:
+    template<class G, class... B>
+    bound(G &&fn, B&&... args) :
+        m_fn{std::forward<G>(fn)},
+        m_args{std::forward<B>(args)...}
+    {}
+
+    template<class... A>
+    decltype(auto) operator()(A&&... args)
+    {
+        return std::apply([&](auto&... b) -> decltype(auto) {
+            return std::invoke(m_fn, b..., std::forward<A>(args)...);
+        }, m_args);
+    }
+
+private:
+    F m_fn;
+    std::tuple<Bound...> m_args;
+};
+
+/// The delegate type left over after binding the first n of Args...
+///
+template<size_t n, class Ret, class... Args>
+struct bind_result
+{
+    static_assert(n <= sizeof...(Args), "bind_front: too many bound arguments");
+
+    template<size_t... I>
+    static auto drop(std::index_sequence<I...>)
+        -> delegate<Ret, std::tuple_element_t<n + I, std::tuple<Args...>>...>;
+
+    using type =
+        decltype(drop(std::make_index_sequence<sizeof...(Args) - n>{}));
+};
+
+template<size_t n, class Ret, class... Args>
+using bind_result_t = typename bind_result<n, Ret, Args...>::type;
+
+template<class D, class F, class... A>
+static D make_bound(A&&... args)
+{
+    static_assert(can_emplace<F>(),
+        "bind_front: target and bound arguments do not fit in state_t");
+
+    return D(std::in_place_type<F>, std::forward<A>(args)...);
+}
+
+/// bind_front
+///
+/// Fixes the leading arguments of a function or member function and
+/// returns a delegate taking the rest, e.g. bind_front(&handler, ctx, id)
+/// yields a delegate for handler(ctx, id, _). The bound arguments are
+/// moved or copied directly into the delegate's state, so move-only
+/// arguments are supported. The resulting delegate can be moved, e.g.
+/// into a growing std::vector, but copying it throws std::logic_error.
+///
+template<class R, class... P, class... B>
+auto bind_front(R(*fn)(P...), B&&... args)
+{
+    using D = bind_result_t<sizeof...(B), R, P...>;
+    using F = bound<R(*)(P...), std::decay_t<B>...>;
+
+    return make_bound<D, F>(fn, std::forward<B>(args)...);
+}
+
+template<class C, class R, class... P, class... B>
+auto bind_front(R(C::*memfn)(P...), C *obj, B&&... args)
+{
+    using D = bind_result_t<sizeof...(B), R, P...>;
+    using F = bound<R(C::*)(P...), C *, std::decay_t<B>...>;
+
+    return make_bound<D, F>(memfn, obj, std::forward<B>(args)...);
+}
+
+template<class C, class R, class... P, class... B>
+auto bind_front(R(C::*memfn)(P...) const, const C *obj, B&&... args)
+{
+    using D = bind_result_t<sizeof...(B), R, P...>;
+    using F = bound<R(C::*)(P...) const, const C *, std::decay_t<B>...>;
+
+    return make_bound<D, F>(memfn, obj, std::forward<B>(args)...);
+}
+
+/// chained
+///
+/// A pipeline stage that refers to an existing delegate. The stage is
+/// type-erased, so calling it costs a second indirect call, and the
+/// delegate it points to must outlive the pipeline.
+///
+template<class Ret, class... Args>
+class chained
+{
+public:
+    chained(const delegate<Ret, Args...> &d) : m_d{&d}
+    {}
+
+    template<class... A>
+    Ret operator()(A&&... args) const
+    { return (*m_d)(std::forward<A>(args)...); }
+
+private:
+    const delegate<Ret, Args...> *m_d;
+};
+
+template<class F>
+struct stage
+{
+    using type = F;
+    static constexpr bool erased = false;
+};
+
+template<class Ret, class... Args>
+struct stage<delegate<Ret, Args...>>
+{
+    using type = chained<Ret, Args...>;
+    static constexpr bool erased = true;
+};
+
+template<class F>
+using stage_t = typename stage<std::decay_t<F>>::type;
+
+/// fused
+///
+/// The callable stored by then and compose. Every stage is held inline
+/// and called directly from one stub, feeding each result into the next
+/// stage.
+///
+template<class... S>
+class fused
+{
+public:
+    template<class... G>
+    fused(std::in_place_t, G&&... stages) :
+        m_stages{std::forward<G>(stages)...}
+    {}
+
+    template<class... A>
+    auto operator()(A&&... args)
+    {
+        if constexpr (sizeof...(S) == 1) {
+            return std::invoke(std::get<0>(m_stages), std::forward<A>(args)...);
+        }
+        else {
+            return run<1>(
+                std::invoke(std::get<0>(m_stages), std::forward<A>(args)...));
+        }
+    }
+
+private:
+    template<size_t i, class T>
+    auto run(T &&val)
+    {
+        if constexpr (i == sizeof...(S) - 1) {
+            return std::invoke(std::get<i>(m_stages), std::forward<T>(val));
+        }
+        else {
+            return run<i + 1>(std::invoke(std::get<i>(m_stages), std::forward<T>(val)));
+        }
+    }
+
+    std::tuple<S...> m_stages;
+};
+
+template<class... Args>
+struct signature
+{};
+
+template<class R, class... A>
+static signature<A...> signature_of(R(*)(A...));
+
+template<class R, class... A>
+static signature<A...> signature_of(const delegate<R, A...> &);
+
+template<class F, class... Args, class... S>
+static auto make_pipeline(signature<Args...>, S&&... stages)
+{
+    using Ret = std::invoke_result_t<F &, Args...>;
+
+    static_assert(can_emplace<F>(),
+        "then: stages do not fit in state_t, chain them through delegates");
+
+    return delegate<Ret, Args...>(
+        std::in_place_type<F>, std::in_place, std::forward<S>(stages)...);
+}
+
+/// then
+///
+/// Builds a delegate that runs each stage on the result of the previous
+/// one, i.e. then(&decode, &validate, &route)(x) is route(validate(decode(x))).
+/// The first stage must be a function pointer or a delegate so that the
+/// signature can be deduced.
+///
+/// Stages of known type (function pointers, bound callables) are fused
+/// into a single stub. Delegate stages are type-erased and are chained
+/// by reference instead, so they must outlive the result.
+///
+template<class First, class... Rest>
+auto then(First &&first, Rest&&... rest)
+{
+    static_assert(
+        ((!stage<std::decay_t<First>>::erased ||
+            std::is_lvalue_reference_v<First>) && ... &&
+         (!stage<std::decay_t<Rest>>::erased ||
+            std::is_lvalue_reference_v<Rest>)),
+        "then: delegate stages are chained by reference and must be lvalues");
+
+    using F = fused<stage_t<First>, stage_t<Rest>...>;
+
+    return make_pipeline<F>(
+        decltype(signature_of(first)){},
+        std::forward<First>(first), std::forward<Rest>(rest)...);
+}
+
+template<class T, size_t... I>
+static auto compose_reversed(T &&stages, std::index_sequence<I...>)
+{
+    constexpr auto n = sizeof...(I);
+    return then(std::get<n - 1 - I>(std::move(stages))...);
+}
+
+/// compose
+///
+/// The same as then with the stages in mathematical order, i.e.
+/// compose(&route, &validate, &decode)(x) is route(validate(decode(x))).
+///
+template<class... S>
+auto compose(S&&... stages)
+{
+    return compose_reversed(
+        std::forward_as_tuple(std::forward<S>(stages)...),
+        std::make_index_sequence<sizeof...(S)>{});
+}
+
 #endif
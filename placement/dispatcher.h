@@ -0,0 +1,140 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file dispatcher.h
+///
+
+#ifndef BFDISPATCHER_H
+#define BFDISPATCHER_H
+
+#include "delegate.h"
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <vector>
+
+/// type index
+///
+/// The position of T in Ts..., computed at compile time. Listing each
+/// type exactly once is enforced.
+///
+template<class T, class... Ts>
+struct type_index_of
+{
+    static constexpr size_t find()
+    {
+        constexpr bool same[] = {std::is_same_v<T, Ts>..., false};
+        size_t matches = 0;
+        size_t index = 0;
+
+        for (size_t i = 0; i < sizeof...(Ts); i++) {
+            if (same[i]) {
+                index = i;
+                matches++;
+            }
+        }
+
+        return matches == 1 ? index : sizeof...(Ts);
+    }
+
+    static constexpr size_t value = find();
+    static_assert(value < sizeof...(Ts),
+        "dispatcher: message type is not listed exactly once");
+};
+
+/// dispatcher
+///
+/// Routes messages to handlers by type. Every message type is listed up
+/// front, which gives each one a dense id (its position in Msgs...) at
+/// compile time, without RTTI. Handlers for type T are a
+/// delegate<void, const T&> list stored at index id<T> of a tuple, so
+/// dispatch(msg) resolves the list at compile time.
+///
+/// For messages whose type is only known at run time (e.g. decoded from
+/// the wire), dispatch(id, ptr) looks up a per-type trampoline in a flat
+/// array indexed by id.
+///
+template<class... Msgs>
+class dispatcher
+{
+public:
+    /// The dense id of message type T
+    ///
+    template<class T>
+    static constexpr size_t id = type_index_of<T, Msgs...>::value;
+
+    /// The number of message types
+    ///
+    static constexpr size_t size = sizeof...(Msgs);
+
+    /// Subscribe
+    ///
+    /// Adds a handler for messages of type T.
+    ///
+    template<class T>
+    void subscribe(delegate<void, const T &> handler)
+    { std::get<id<T>>(m_handlers).emplace_back(std::move(handler)); }
+
+    /// Dispatch
+    ///
+    /// Calls every handler subscribed to T, in subscription order.
+    ///
+    template<class T>
+    void dispatch(const T &msg) const
+    {
+        for (const auto &h : std::get<id<T>>(m_handlers)) {
+            h(msg);
+        }
+    }
+
+    /// Dispatch (run-time type)
+    ///
+    /// Calls every handler subscribed to the message type with the given
+    /// id; msg must point to a message of that type.
+    ///
+    /// @return false if type is not a valid id, e.g. a corrupt tag read
+    ///     from the wire
+    ///
+    bool dispatch(size_t type, const void *msg) const
+    {
+        if (type >= size) {
+            return false;
+        }
+
+        s_erased[type](*this, msg);
+        return true;
+    }
+
+private:
+    template<class T>
+    static void s_dispatch(const dispatcher &self, const void *msg)
+    { self.dispatch(*static_cast<const T *>(msg)); }
+
+    static constexpr std::array<void (*)(const dispatcher &, const void *), size>
+        s_erased = {&s_dispatch<Msgs>...};
+
+    std::tuple<std::vector<delegate<void, const Msgs &>>...> m_handlers;
+};
+
+#endif
@@ -0,0 +1,243 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file handlers.h
+///
+
+#ifndef BFHANDLERS_H
+#define BFHANDLERS_H
+
+#include "delegate.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+/// handler list
+///
+/// A list of delegates that are all called with the same arguments,
+/// with room for n of them inside the object. Only a list that grows
+/// past n allocates. Calling goes through a data pointer that refers to
+/// either the inline buffer or the heap block, so the call loop is the
+/// same tight loop in both cases.
+///
+/// While every stored callable is trivially copyable (function pointers,
+/// memfn/object pairs, small trivial lambdas) growing, removing and
+/// moving the list relocate delegates with memcpy.
+///
+template<size_t n, class... Args>
+class handler_list
+{
+    static_assert(n > 0, "handler_list: inline capacity must be at least 1");
+
+public:
+    using delegate_t = delegate<void, Args...>;
+
+    handler_list() noexcept = default;
+
+    handler_list(handler_list &&other) noexcept
+    { take(std::move(other)); }
+
+    handler_list &operator=(handler_list &&other) noexcept
+    {
+        if (this != &other) {
+            clear();
+            release();
+            take(std::move(other));
+        }
+
+        return *this;
+    }
+
+    handler_list(const handler_list &) = delete;
+    handler_list &operator=(const handler_list &) = delete;
+
+   ~handler_list()
+    {
+        clear();
+        release();
+    }
+
+    /// Add
+    ///
+    /// fn may be one of this list's own handlers, which grow() moves and
+    /// frees, so it is copied first when the list has to grow.
+    ///
+    void add(const delegate_t &fn)
+    {
+        if (m_size == m_capacity) {
+            delegate_t copy(fn);
+            grow();
+            new (&m_data[m_size++]) delegate_t(std::move(copy));
+        }
+        else {
+            new (&m_data[m_size++]) delegate_t(fn);
+        }
+
+        m_trivial = m_trivial && m_data[m_size - 1].trivially_relocatable();
+    }
+
+    /// Remove
+    ///
+    /// Removes the first handler equal to fn (see delegate::operator==),
+    /// keeping the order of the rest. Returns false if there is none.
+    ///
+    bool remove(const delegate_t &fn)
+    {
+        for (size_t i = 0; i < m_size; i++) {
+            if (m_data[i] != fn) {
+                continue;
+            }
+
+            m_data[i].~delegate_t();
+
+            if (m_trivial) {
+                std::memmove(
+                    static_cast<void *>(&m_data[i]), &m_data[i + 1],
+                    (m_size - i - 1) * sizeof(delegate_t));
+            }
+            else {
+                for (auto j = i + 1; j < m_size; j++) {
+                    new (&m_data[j - 1]) delegate_t(std::move(m_data[j]));
+                    m_data[j].~delegate_t();
+                }
+            }
+
+            m_size--;
+            return true;
+        }
+
+        return false;
+    }
+
+    /// Call operator
+    ///
+    void operator()(Args... args) const
+    {
+        const auto last = m_data + m_size;
+
+        for (auto fn = m_data; fn != last; ++fn) {
+            (*fn)(static_cast<Args>(args)...);
+        }
+    }
+
+    void clear() noexcept
+    {
+        for (size_t i = 0; i < m_size; i++) {
+            m_data[i].~delegate_t();
+        }
+
+        m_size = 0;
+        m_trivial = true;
+    }
+
+    size_t size() const noexcept
+    { return m_size; }
+
+    size_t capacity() const noexcept
+    { return m_capacity; }
+
+    /// True if the handlers are stored in the object itself
+    ///
+    bool is_inline() const noexcept
+    { return m_data == inline_data(); }
+
+    const delegate_t *begin() const noexcept
+    { return m_data; }
+
+    const delegate_t *end() const noexcept
+    { return m_data + m_size; }
+
+private:
+    delegate_t *inline_data() const noexcept
+    { return std::launder(reinterpret_cast<delegate_t *>(const_cast<uint8_t *>(m_inline))); }
+
+    /// Moves size delegates from src to the uninitialized dst
+    ///
+    void relocate(delegate_t *dst, delegate_t *src) noexcept
+    {
+        if (m_trivial) {
+            std::memcpy(static_cast<void *>(dst), src, m_size * sizeof(delegate_t));
+            return;
+        }
+
+        for (size_t i = 0; i < m_size; i++) {
+            new (&dst[i]) delegate_t(std::move(src[i]));
+            src[i].~delegate_t();
+        }
+    }
+
+    void grow()
+    {
+        const auto capacity = m_capacity * 2;
+        const auto data = static_cast<delegate_t *>(
+            ::operator new(capacity * sizeof(delegate_t), std::align_val_t{alignof(delegate_t)}));
+
+        relocate(data, m_data);
+        release();
+
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+    void release() noexcept
+    {
+        if (!is_inline()) {
+            ::operator delete(m_data, std::align_val_t{alignof(delegate_t)});
+        }
+
+        m_data = inline_data();
+        m_capacity = n;
+    }
+
+    /// Takes other's handlers; this list must be empty and inline
+    ///
+    void take(handler_list &&other) noexcept
+    {
+        m_size = other.m_size;
+        m_trivial = other.m_trivial;
+
+        if (other.is_inline()) {
+            relocate(m_data, other.m_data);
+        }
+        else {
+            m_data = other.m_data;
+            m_capacity = other.m_capacity;
+            other.m_data = other.inline_data();
+            other.m_capacity = n;
+        }
+
+        other.m_size = 0;
+        other.m_trivial = true;
+    }
+
+    delegate_t *m_data{inline_data()};
+    size_t m_size{};
+    size_t m_capacity{n};
+    bool m_trivial{true};
+
+    alignas(delegate_t) uint8_t m_inline[n * sizeof(delegate_t)];
+};
+
+#endif
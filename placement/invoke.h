@@ -0,0 +1,208 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file invoke.h
+///
+
+#ifndef BFINVOKE_H
+#define BFINVOKE_H
+
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+/// invoke_as
+///
+/// Calls fn with args converted to fn's own parameter types, as
+/// multicast does: a by-value parameter gets a fresh copy for each call
+/// and a reference parameter binds to the caller's argument, so e.g.
+/// delegate<void, int &> sees the caller's int and a const Big &
+/// parameter is never copied.
+///
+template<
+    template<class, class...> class D, class Ret, class... Args, class... A>
+Ret invoke_as(const D<Ret, Args...> &fn, A&... args)
+{ return fn(static_cast<Args>(args)...); }
+
+/// invoke_all
+///
+/// Calls every delegate in [first, last) with the same arguments. Each
+/// call depends on three loads: the delegate, the object it is bound to
+/// and the target's code. To overlap them, the delegate 2 * distance
+/// ahead is prefetched, and the delegate distance ahead, whose own
+/// prefetch has landed by then, gets prefetch() called on it. That
+/// prefetches the address held in the first word of its state: the
+/// bound object for memfn delegates, the function for function
+/// pointers, and whatever happens to be there for other callables.
+///
+/// The arguments are passed as invoke_as() does, so the delegates never
+/// see each other's moved-from values. The right distance depends on how
+/// long each handler runs; the default suits short handlers.
+///
+template<size_t distance = 8, class D, class... A>
+void invoke_all(const D *first, const D *last, A&&... args)
+{
+    static_assert(distance > 0);
+
+    const auto n = static_cast<size_t>(last - first);
+    size_t i = 0;
+
+    if (n > 2 * distance) {
+        for (; i < 2 * distance; i++) {
+            __builtin_prefetch(first + i);
+        }
+        for (i = 0; i < distance; i++) {
+            first[i].prefetch();
+        }
+
+        for (i = 0; i < n - 2 * distance; i++) {
+            __builtin_prefetch(first + i + 2 * distance);
+            first[i + distance].prefetch();
+            invoke_as(first[i], args...);
+        }
+    }
+
+    for (; i < n; i++) {
+        if (i + distance < n) {
+            first[i + distance].prefetch();
+        }
+        invoke_as(first[i], args...);
+    }
+}
+
+/// reducers
+///
+/// A reducer combines the return values of a multicast call. It
+/// provides the initial accumulator, folds each value into it, and says
+/// whether the result is already decided so the remaining delegates can
+/// be skipped.
+///
+template<class T>
+struct reduce_sum
+{
+    T init() const noexcept
+    { return T{}; }
+
+    void fold(T &acc, T val) const noexcept
+    { acc += val; }
+
+    bool done(const T &) const noexcept
+    { return false; }
+};
+
+template<class T>
+struct reduce_min
+{
+    T init() const noexcept
+    { return std::numeric_limits<T>::max(); }
+
+    void fold(T &acc, T val) const noexcept
+    { acc = val < acc ? val : acc; }
+
+    bool done(const T &) const noexcept
+    { return false; }
+};
+
+template<class T>
+struct reduce_max
+{
+    T init() const noexcept
+    { return std::numeric_limits<T>::lowest(); }
+
+    void fold(T &acc, T val) const noexcept
+    { acc = acc < val ? val : acc; }
+
+    bool done(const T &) const noexcept
+    { return false; }
+};
+
+/// Stops at the first delegate that returns true
+///
+struct reduce_any
+{
+    bool init() const noexcept
+    { return false; }
+
+    void fold(bool &acc, bool val) const noexcept
+    { acc = val; }
+
+    bool done(bool acc) const noexcept
+    { return acc; }
+};
+
+/// Stops at the first delegate that returns false
+///
+struct reduce_all
+{
+    bool init() const noexcept
+    { return true; }
+
+    void fold(bool &acc, bool val) const noexcept
+    { acc = val; }
+
+    bool done(bool acc) const noexcept
+    { return !acc; }
+};
+
+/// Stops at the first delegate whose result converts to true, e.g. a
+/// non-null pointer or an engaged std::optional, and returns it
+///
+template<class T>
+struct reduce_first
+{
+    T init() const
+    { return T{}; }
+
+    void fold(T &acc, T &&val) const
+    { acc = std::move(val); }
+
+    bool done(const T &acc) const
+    { return static_cast<bool>(acc); }
+};
+
+/// invoke_reduce
+///
+/// Calls the delegates in [first, last) in order, passing args as
+/// invoke_as() does, and folds their return values with reducer,
+/// stopping early once reducer.done() is true. The
+/// accumulator is a local, so arithmetic reductions stay in registers,
+/// and for reducers whose done() is constant false the check compiles
+/// away.
+///
+template<class R, class D, class... A>
+auto invoke_reduce(const D *first, const D *last, R reducer, A&&... args)
+{
+    auto acc = reducer.init();
+
+    for (; first != last; ++first) {
+        reducer.fold(acc, invoke_as(*first, args...));
+
+        if (reducer.done(acc)) {
+            break;
+        }
+    }
+
+    return acc;
+}
+
+#endif
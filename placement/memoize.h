@@ -0,0 +1,299 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file memoize.h
+///
+
+#ifndef BFMEMOIZE_H
+#define BFMEMOIZE_H
+
+#include "delegate.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+/// memo table
+///
+/// A fixed-capacity cache of results keyed by argument tuples. A key
+/// may only live in the window of slots starting at its hash, so lookups
+/// probe at most window adjacent slots and there are no tombstones.
+/// When the window is full, CLOCK picks the victim: referenced slots get
+/// their bit cleared and a second chance, the first unreferenced one is
+/// replaced.
+///
+template<size_t capacity, class Ret, class Key>
+class memo_table
+{
+    static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0,
+        "memoize: capacity must be a power of two");
+
+public:
+    static constexpr size_t window = capacity < 8 ? capacity : 8;
+
+    template<class Compute>
+    Ret get(size_t hash, const Key &key, Compute compute)
+    {
+        const auto first = hash & (capacity - 1);
+
+        for (size_t i = 0; i < window; i++) {
+            auto &s = m_slots[(first + i) & (capacity - 1)];
+
+            if (!s.used) {
+                break;
+            }
+
+            if (s.key == key) {
+                s.ref = true;
+                m_hits++;
+                return s.value;
+            }
+        }
+
+        m_misses++;
+
+        auto &s = victim(first);
+        s.value = compute();
+        s.key = key;
+        s.used = true;
+        s.ref = false;
+
+        return s.value;
+    }
+
+    uint64_t hits() const noexcept
+    { return m_hits; }
+
+    uint64_t misses() const noexcept
+    { return m_misses; }
+
+private:
+    struct slot
+    {
+        Key key;
+        Ret value;
+        bool used;
+        bool ref;
+    };
+
+    slot &victim(size_t first) noexcept
+    {
+        for (size_t i = 0; i < window; i++) {
+            auto &s = m_slots[(first + i) & (capacity - 1)];
+            if (!s.used) {
+                return s;
+            }
+        }
+
+        for (size_t i = 0;; i = (i + 1) % window) {
+            auto &s = m_slots[(first + i) & (capacity - 1)];
+            if (!s.ref) {
+                return s;
+            }
+            s.ref = false;
+        }
+    }
+
+    std::array<slot, capacity> m_slots{};
+    uint64_t m_hits{};
+    uint64_t m_misses{};
+};
+
+/// memoized
+///
+/// Wraps a delegate that is a pure function of small arguments and
+/// caches its results in a memo_table of the given capacity. Arguments
+/// must be trivially copyable, hashable with std::hash and comparable
+/// with ==.
+///
+/// In the default mode the table is part of the object and must not be
+/// used from several threads at once. With per_thread set, every thread
+/// gets its own table on first use, so there is no sharing at all;
+/// hits() and misses() then describe the calling thread's table. Tables
+/// belong to the thread and are freed when it exits.
+///
+/// A per_thread object finds its table by an id that is handed back
+/// when it is destroyed and reused by the next object, so the tables
+/// per thread never outnumber the objects alive at once. Each object
+/// also gets a fresh generation, and a thread that finds a table left
+/// by an id's previous owner clears it before use.
+///
+template<size_t capacity, bool per_thread, class Ret, class... Args>
+class basic_memoized
+{
+    using key_t = std::tuple<std::decay_t<Args>...>;
+    using table_t = memo_table<capacity, Ret, key_t>;
+
+    static_assert((std::is_trivially_copyable_v<std::decay_t<Args>> && ...),
+        "memoize: arguments must be trivially copyable");
+
+public:
+    explicit basic_memoized(delegate<Ret, Args...> fn) :
+        m_fn{std::move(fn)}
+    {}
+
+    /// Call operator
+    ///
+    /// Returns the cached result for args, calling the delegate on a miss.
+    ///
+    Ret operator()(Args... args)
+    {
+        const key_t key{args...};
+
+        return table().get(hash(args...), key, [&] {
+            return m_fn(static_cast<Args>(args)...);
+        });
+    }
+
+    uint64_t hits()
+    { return table().hits(); }
+
+    uint64_t misses()
+    { return table().misses(); }
+
+private:
+    static size_t hash(const Args&... args) noexcept
+    {
+        uint64_t h = 0x9e3779b97f4a7c15;
+
+        ((h = (h ^ std::hash<std::decay_t<Args>>{}(args)) * 0xff51afd7ed558ccd,
+          h ^= h >> 33), ...);
+
+        return static_cast<size_t>(h);
+    }
+
+    /// The id and generation of a per_thread object. Copies get their
+    /// own id and generation, so they never share cached results.
+    ///
+    class thread_key
+    {
+    public:
+        thread_key() :
+            m_id{acquire()},
+            m_gen{s_gens.fetch_add(1, std::memory_order_relaxed)}
+        {}
+
+        thread_key(const thread_key &) :
+            thread_key()
+        {}
+
+        thread_key &operator=(const thread_key &) noexcept
+        {
+            m_gen = s_gens.fetch_add(1, std::memory_order_relaxed);
+            return *this;
+        }
+
+       ~thread_key()
+        {
+            std::lock_guard lock(ids().lock);
+            ids().free.push_back(m_id);
+        }
+
+        size_t id() const noexcept
+        { return m_id; }
+
+        uint64_t gen() const noexcept
+        { return m_gen; }
+
+    private:
+        struct id_list
+        {
+            std::mutex lock;
+            std::vector<size_t> free;
+            size_t next;
+        };
+
+        static id_list &ids()
+        {
+            static id_list self{};
+            return self;
+        }
+
+        static size_t acquire()
+        {
+            std::lock_guard lock(ids().lock);
+
+            if (ids().free.empty()) {
+                return ids().next++;
+            }
+
+            const auto id = ids().free.back();
+            ids().free.pop_back();
+
+            return id;
+        }
+
+        static inline std::atomic<uint64_t> s_gens{1};
+
+        size_t m_id;
+        uint64_t m_gen;
+    };
+
+    struct thread_table
+    {
+        uint64_t gen;
+        std::unique_ptr<table_t> table;
+    };
+
+    table_t &table()
+    {
+        if constexpr (per_thread) {
+            thread_local std::vector<thread_table> s_tables;
+
+            if (m_store.id() >= s_tables.size()) {
+                s_tables.resize(m_store.id() + 1);
+            }
+
+            auto &t = s_tables[m_store.id()];
+            if (t.gen != m_store.gen()) {
+                t.gen = m_store.gen();
+                t.table = std::make_unique<table_t>();
+            }
+
+            return *t.table;
+        }
+        else {
+            return m_store;
+        }
+    }
+
+    delegate<Ret, Args...> m_fn;
+
+    /// The table itself, or in per_thread mode the key of this object's
+    /// table in every thread's table list.
+    ///
+    std::conditional_t<per_thread, thread_key, table_t> m_store{};
+};
+
+template<size_t capacity, class Ret, class... Args>
+using memoized = basic_memoized<capacity, false, Ret, Args...>;
+
+template<size_t capacity, class Ret, class... Args>
+using thread_memoized = basic_memoized<capacity, true, Ret, Args...>;
+
+#endif
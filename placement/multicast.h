@@ -0,0 +1,165 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file multicast.h
+///
+
+#ifndef BFMULTICAST_H
+#define BFMULTICAST_H
+
+#include "delegate.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/// multicast
+///
+/// A list of delegates that are all called with the same arguments.
+/// Handlers are kept in a dense array for calling, and a hash index
+/// from delegate hash to position lets remove() find a handler by value
+/// in O(1) instead of scanning. Removal moves the last handler into the
+/// hole, so call order is not preserved across removals.
+///
+/// Only function pointers and memfn/object pairs can be removed by
+/// value (see delegate::same_target); other callables stay until
+/// clear(). The list must not be changed while it is being called.
+///
+template<class... Args>
+class multicast
+{
+public:
+    using handler_t = delegate<void, Args...>;
+
+    /// Add
+    ///
+    /// Appends fn. Adding the same target twice makes it called twice.
+    ///
+    /// fn may be one of this list's own handlers, which push_back() can
+    /// move, so its hash is taken first.
+    ///
+    void add(const handler_t &fn)
+    {
+        const auto pos = static_cast<uint32_t>(m_handlers.size());
+        const auto hash = fn.target_hash();
+
+        m_handlers.push_back(fn);
+        m_index.emplace(hash, pos);
+    }
+
+    /// Remove
+    ///
+    /// Removes one handler equal to fn. Returns false if there is none.
+    ///
+    bool remove(const handler_t &fn)
+    {
+        const auto it = find(fn.target_hash(), [&](uint32_t pos) {
+            return m_handlers[pos] == fn;
+        });
+
+        if (it == m_index.end()) {
+            return false;
+        }
+
+        const auto pos = it->second;
+        const auto last = static_cast<uint32_t>(m_handlers.size() - 1);
+
+        m_index.erase(it);
+
+        if (pos != last) {
+            const auto moved = find(m_handlers[last].target_hash(), [&](uint32_t p) {
+                return p == last;
+            });
+
+            if (moved != m_index.end()) {
+                moved->second = pos;
+            }
+
+            m_handlers[pos] = std::move(m_handlers[last]);
+        }
+
+        m_handlers.pop_back();
+        return true;
+    }
+
+    /// Contains
+    ///
+    bool contains(const handler_t &fn) const
+    {
+        const auto range = m_index.equal_range(fn.target_hash());
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (m_handlers[it->second] == fn) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// Call operator
+    ///
+    void operator()(Args... args) const
+    {
+        for (const auto &fn : m_handlers) {
+            fn(static_cast<Args>(args)...);
+        }
+    }
+
+    void clear() noexcept
+    {
+        m_handlers.clear();
+        m_index.clear();
+    }
+
+    size_t size() const noexcept
+    { return m_handlers.size(); }
+
+    const handler_t *begin() const noexcept
+    { return m_handlers.data(); }
+
+    const handler_t *end() const noexcept
+    { return m_handlers.data() + m_handlers.size(); }
+
+private:
+    using index_t = std::unordered_multimap<size_t, uint32_t>;
+
+    template<class Pred>
+    typename index_t::iterator find(size_t hash, Pred pred)
+    {
+        const auto range = m_index.equal_range(hash);
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (pred(it->second)) {
+                return it;
+            }
+        }
+
+        return m_index.end();
+    }
+
+    std::vector<handler_t> m_handlers;
+    index_t m_index;
+};
+
+#endif
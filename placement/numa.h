@@ -0,0 +1,361 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file numa.h
+///
+
+#ifndef BFNUMA_H
+#define BFNUMA_H
+
+#include "delegate.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// numa topology
+///
+/// The NUMA nodes of the machine and the node of every CPU, read once
+/// from /sys/devices/system/node. If that is missing or unreadable the
+/// machine is treated as a single node holding every CPU.
+///
+class numa_topology
+{
+public:
+    /// The machine's topology, discovered on first use
+    ///
+    static const numa_topology &system()
+    {
+        static const numa_topology s_topology;
+        return s_topology;
+    }
+
+    uint32_t nodes() const noexcept
+    { return m_nodes; }
+
+    /// The node of cpu, or 0 if cpu is unknown
+    ///
+    uint32_t node_of(int cpu) const noexcept
+    {
+        if (cpu < 0 || static_cast<size_t>(cpu) >= m_cpu_node.size()) {
+            return 0;
+        }
+
+        return m_cpu_node[static_cast<size_t>(cpu)];
+    }
+
+    /// Current node
+    ///
+    /// The node of the CPU the calling thread was on when it first
+    /// asked. Threads are expected to be pinned; a thread that moves to
+    /// another node can refresh_node().
+    ///
+    static uint32_t current_node() noexcept
+    {
+        if (auto node = s_node(); node >= 0) {
+            return static_cast<uint32_t>(node);
+        }
+
+        return refresh_node();
+    }
+
+    static uint32_t refresh_node() noexcept
+    {
+        const auto node = system().node_of(sched_getcpu());
+
+        s_node() = static_cast<int>(node);
+        return node;
+    }
+
+    /// Node alloc
+    ///
+    /// Maps bytes of memory that the kernel prefers to place on node.
+    /// If the preference cannot be set (no NUMA support, or no such
+    /// node) the memory is placed normally.
+    ///
+    static void *node_alloc(size_t bytes, uint32_t node)
+    {
+        const auto ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (ptr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        if (node < 64) {
+            const unsigned long mask = 1UL << node;
+            syscall(SYS_mbind, ptr, bytes, MPOL_PREFERRED, &mask, 64, 0);
+        }
+
+        return ptr;
+    }
+
+    static void node_free(void *ptr, size_t bytes) noexcept
+    { munmap(ptr, bytes); }
+
+private:
+    numa_topology()
+    {
+        const auto cpus = sysconf(_SC_NPROCESSORS_CONF);
+        m_cpu_node.resize(cpus > 0 ? static_cast<size_t>(cpus) : 1);
+
+        std::vector<uint32_t> online;
+        if (!read_list("/sys/devices/system/node/online", online) || online.empty()) {
+            return;
+        }
+
+        for (const auto node : online) {
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+
+            std::vector<uint32_t> list;
+            if (!read_list(path, list)) {
+                continue;
+            }
+
+            for (const auto cpu : list) {
+                if (cpu >= m_cpu_node.size()) {
+                    m_cpu_node.resize(cpu + 1);
+                }
+                m_cpu_node[cpu] = node;
+            }
+
+            m_nodes = std::max(m_nodes, node + 1);
+        }
+    }
+
+    /// Parses a kernel list such as "0-3,8,10-11"
+    ///
+    static bool read_list(const char *path, std::vector<uint32_t> &out)
+    {
+        const auto f = fopen(path, "re");
+        if (f == nullptr) {
+            return false;
+        }
+
+        unsigned first;
+        unsigned last;
+        int sep;
+
+        while (fscanf(f, "%u", &first) == 1) {
+            last = first;
+            sep = fgetc(f);
+
+            if (sep == '-') {
+                if (fscanf(f, "%u", &last) != 1) {
+                    break;
+                }
+                sep = fgetc(f);
+            }
+
+            for (auto i = first; i <= last; i++) {
+                out.push_back(i);
+            }
+
+            if (sep != ',') {
+                break;
+            }
+        }
+
+        fclose(f);
+        return true;
+    }
+
+    static int &s_node() noexcept
+    {
+        thread_local int node = -1;
+        return node;
+    }
+
+    std::vector<uint32_t> m_cpu_node;
+    uint32_t m_nodes{1};
+};
+
+/// replicated table
+///
+/// A fixed-size table of delegates for data that every core reads and
+/// few write, e.g. handler tables. There is one copy per NUMA node,
+/// allocated on that node, and a reader finds its node's copy with one
+/// thread-local lookup, so calls never read remote memory.
+///
+/// Writes are serialized and update every replica. A write never
+/// changes a copy in place: it publishes a new copy per node and
+/// retires the old ones, so readers are never blocked and never see a
+/// half-written delegate. Retired copies are freed by reclaim(), which
+/// the owner calls once no reader can still be using them (e.g. after
+/// every reader thread has passed a quiescent point), and by the
+/// destructor.
+///
+/// Entries are empty unless given an init delegate or set, and calling
+/// an empty entry does nothing (see empty_target), so a sparse table
+/// needs no null check per dispatch. set(i, {}) empties an entry.
+///
+template<class Ret, class... Args>
+class replicated_table
+{
+public:
+    using delegate_t = delegate<Ret, Args...>;
+
+    /// @param size the number of entries
+    /// @param init the delegate every entry starts as, empty by default
+    /// @param nodes the number of replicas, one per node by default
+    ///
+    replicated_table(
+        size_t size, const delegate_t &init = {},
+        uint32_t nodes = numa_topology::system().nodes()
+    ) :
+        m_size{size},
+        m_nodes{nodes},
+        m_current{std::make_unique<current[]>(nodes)}
+    {
+        for (uint32_t node = 0; node < m_nodes; node++) {
+            const auto copy = allocate(node);
+
+            for (size_t i = 0; i < m_size; i++) {
+                new (&copy[i]) delegate_t(init);
+            }
+
+            m_current[node].entries.store(copy, std::memory_order_release);
+        }
+    }
+
+   ~replicated_table()
+    {
+        reclaim();
+
+        for (uint32_t node = 0; node < m_nodes; node++) {
+            release(m_current[node].entries.load(std::memory_order_relaxed));
+        }
+    }
+
+    replicated_table(const replicated_table &) = delete;
+    replicated_table &operator=(const replicated_table &) = delete;
+
+    /// The calling thread's node's copy of entry i
+    ///
+    const delegate_t &operator[](size_t i) const noexcept
+    { return local()[i]; }
+
+    /// Calls entry i through the local copy
+    ///
+    Ret operator()(size_t i, Args... args) const
+    { return local()[i](static_cast<Args>(args)...); }
+
+    /// Node's copy of entry i
+    ///
+    const delegate_t &replica(uint32_t node, size_t i) const noexcept
+    { return m_current[node].entries.load(std::memory_order_acquire)[i]; }
+
+    /// Set
+    ///
+    /// Replaces entry i with d in every replica.
+    ///
+    void set(size_t i, const delegate_t &d)
+    {
+        std::lock_guard lock(m_lock);
+
+        for (uint32_t node = 0; node < m_nodes; node++) {
+            const auto old = m_current[node].entries.load(std::memory_order_relaxed);
+            const auto copy = allocate(node);
+
+            for (size_t j = 0; j < m_size; j++) {
+                new (&copy[j]) delegate_t(j == i ? d : old[j]);
+            }
+
+            m_current[node].entries.store(copy, std::memory_order_release);
+            m_retired.push_back(old);
+        }
+    }
+
+    /// Reclaim
+    ///
+    /// Frees the copies retired by set(). No reader may still be using
+    /// a copy that was current before the last set().
+    ///
+    void reclaim()
+    {
+        std::lock_guard lock(m_lock);
+
+        for (const auto r : m_retired) {
+            release(r);
+        }
+
+        m_retired.clear();
+    }
+
+    size_t size() const noexcept
+    { return m_size; }
+
+    uint32_t nodes() const noexcept
+    { return m_nodes; }
+
+private:
+    struct alignas(64) current
+    {
+        std::atomic<delegate_t *> entries;
+    };
+
+    const delegate_t *local() const noexcept
+    {
+        const auto node = numa_topology::current_node();
+        return m_current[node < m_nodes ? node : 0].entries.load(std::memory_order_acquire);
+    }
+
+    size_t bytes() const noexcept
+    {
+        const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return (std::max<size_t>(m_size, 1) * sizeof(delegate_t) + page - 1) / page * page;
+    }
+
+    delegate_t *allocate(uint32_t node) const
+    { return static_cast<delegate_t *>(numa_topology::node_alloc(bytes(), node)); }
+
+    void release(delegate_t *entries) const noexcept
+    {
+        for (size_t i = 0; i < m_size; i++) {
+            entries[i].~delegate_t();
+        }
+
+        numa_topology::node_free(entries, bytes());
+    }
+
+    size_t m_size;
+    uint32_t m_nodes;
+
+    std::unique_ptr<current[]> m_current;
+    std::vector<delegate_t *> m_retired;
+    std::mutex m_lock;
+};
+
+#endif
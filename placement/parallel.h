@@ -0,0 +1,407 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file parallel.h
+///
+
+#ifndef BFPARALLEL_H
+#define BFPARALLEL_H
+
+#include "delegate.h"
+#include "invoke.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// latch
+///
+/// Counts down from n; wait() returns once the count reaches zero.
+/// Counting down is one atomic decrement, and only the last one makes a
+/// system call, and only if somebody is waiting.
+///
+/// The latch usually lives on the waiter's stack, so the last
+/// count_down() must not touch it once the waiter may have returned.
+/// Its final access is the store to m_done, and waiters return only
+/// after seeing that, not when the count reaches zero.
+///
+class latch
+{
+public:
+    explicit latch(uint32_t n) noexcept :
+        m_count{n},
+        m_done{n == 0}
+    {}
+
+    void count_down() noexcept
+    {
+        if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (m_waiting.load(std::memory_order_seq_cst) != 0) {
+                syscall(SYS_futex, &m_count, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+            }
+
+            m_done.store(true, std::memory_order_release);
+        }
+    }
+
+    bool try_wait() const noexcept
+    { return m_done.load(std::memory_order_acquire); }
+
+    void wait() noexcept
+    {
+        m_waiting.store(1, std::memory_order_seq_cst);
+
+        for (auto c = m_count.load(std::memory_order_seq_cst); c != 0;
+             c = m_count.load(std::memory_order_seq_cst)) {
+            syscall(SYS_futex, &m_count, FUTEX_WAIT_PRIVATE, c, nullptr, nullptr, 0);
+        }
+
+        // The count is zero, so the last count_down() is at most one
+        // futex wake away from setting m_done.
+
+        while (!try_wait()) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<uint32_t> m_count;
+    std::atomic<uint32_t> m_waiting{};
+    std::atomic<bool> m_done;
+};
+
+/// work pool
+///
+/// A fixed set of worker threads with one task queue each. A worker
+/// runs its own queue newest first and, when that is empty, steals the
+/// oldest task of another queue. Tasks submitted from outside the pool
+/// are dealt round robin. The thread that waits for a batch of tasks
+/// helps run them (see help()), so a pool of n workers keeps n + 1
+/// threads busy, and a pool with no workers runs everything inline.
+///
+class work_pool
+{
+public:
+    using task_t = delegate<void>;
+
+    explicit work_pool(uint32_t workers) :
+        m_queues{std::make_unique<queue[]>(std::max(workers, 1u))},
+        m_count{std::max(workers, 1u)}
+    {
+        for (uint32_t i = 0; i < workers; i++) {
+            m_threads.emplace_back(&work_pool::work, this, i);
+        }
+    }
+
+   ~work_pool()
+    {
+        {
+            std::lock_guard lock(m_idle_lock);
+            m_stop = true;
+        }
+
+        m_idle.notify_all();
+
+        for (auto &t : m_threads) {
+            t.join();
+        }
+    }
+
+    work_pool(const work_pool &) = delete;
+    work_pool &operator=(const work_pool &) = delete;
+
+    /// Submit
+    ///
+    void submit(task_t t)
+    {
+        auto &q = m_queues[m_next.fetch_add(1, std::memory_order_relaxed) % m_count];
+
+        {
+            std::lock_guard lock(q.lock);
+            q.tasks.push_back(std::move(t));
+        }
+
+        m_pending.fetch_add(1, std::memory_order_seq_cst);
+
+        {
+            std::lock_guard lock(m_idle_lock);
+        }
+
+        m_idle.notify_one();
+    }
+
+    /// Help
+    ///
+    /// Runs queued tasks until l is done, then returns. If there is
+    /// nothing left to run but l is still counting (the last tasks are
+    /// running elsewhere), blocks on l.
+    ///
+    void help(latch &l)
+    {
+        while (!l.try_wait()) {
+            auto t = take(0);
+
+            if (!t) {
+                l.wait();
+                return;
+            }
+
+            (*t)();
+        }
+    }
+
+    /// The number of worker threads
+    ///
+    uint32_t workers() const noexcept
+    { return static_cast<uint32_t>(m_threads.size()); }
+
+private:
+    struct alignas(64) queue
+    {
+        std::mutex lock;
+        std::deque<task_t> tasks;
+    };
+
+    /// Pops self's newest task, or steals another queue's oldest
+    ///
+    std::optional<task_t> take(uint32_t self)
+    {
+        std::optional<task_t> t;
+
+        for (uint32_t i = 0; i < m_count && !t; i++) {
+            auto &q = m_queues[(self + i) % m_count];
+            std::lock_guard lock(q.lock);
+
+            if (q.tasks.empty()) {
+                continue;
+            }
+
+            if (i == 0) {
+                t.emplace(std::move(q.tasks.back()));
+                q.tasks.pop_back();
+            }
+            else {
+                t.emplace(std::move(q.tasks.front()));
+                q.tasks.pop_front();
+            }
+        }
+
+        if (t) {
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        return t;
+    }
+
+    void work(uint32_t self)
+    {
+        while (true) {
+            if (auto t = take(self)) {
+                (*t)();
+                continue;
+            }
+
+            std::unique_lock lock(m_idle_lock);
+            m_idle.wait(lock, [&] {
+                return m_stop || m_pending.load(std::memory_order_seq_cst) != 0;
+            });
+
+            if (m_stop) {
+                return;
+            }
+        }
+    }
+
+    std::unique_ptr<queue[]> m_queues;
+    uint32_t m_count;
+    std::atomic<uint32_t> m_next{};
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_idle_lock;
+    std::condition_variable m_idle;
+    std::atomic<size_t> m_pending{};
+    bool m_stop{};
+};
+
+/// parallel chunk
+///
+/// One chunk of a parallel multicast. The arguments are referenced,
+/// not copied: the caller waits for every chunk before returning.
+///
+template<class D, class R, class... A>
+struct parallel_chunk
+{
+    using acc_t = decltype(std::declval<R>().init());
+
+    void run()
+    {
+        std::apply([&](A&... a) {
+            acc.emplace(invoke_reduce(first, last, *reducer, a...));
+        }, *args);
+
+        if (done != nullptr) {
+            done->count_down();
+        }
+    }
+
+    const D *first;
+    const D *last;
+    std::tuple<A&...> *args;
+    const R *reducer;
+    latch *done;
+    std::optional<acc_t> acc{};
+};
+
+template<class D, class... A>
+struct parallel_chunk<D, void, A...>
+{
+    void run()
+    {
+        std::apply([&](A&... a) {
+            invoke_all(first, last, a...);
+        }, *args);
+
+        if (done != nullptr) {
+            done->count_down();
+        }
+    }
+
+    const D *first;
+    const D *last;
+    std::tuple<A&...> *args;
+    const void *reducer;
+    latch *done;
+};
+
+/// Runs [first, last) in chunks on pool and returns the finished chunks
+/// in order. The first few delegates are run inline and timed; the
+/// chunk size is then chosen so that a chunk runs for about chunk_us,
+/// but small enough that every thread gets several chunks to balance.
+///
+template<size_t chunk_us, class R, class D, class... A>
+std::vector<parallel_chunk<D, R, A...>> run_parallel(
+    work_pool &pool, const D *first, const D *last, const R *reducer, A&... args)
+{
+    using chunk_t = parallel_chunk<D, R, A...>;
+    constexpr size_t sample = 8;
+
+    std::tuple<A&...> packed{args...};
+    const auto n = static_cast<size_t>(last - first);
+    const auto timed = std::min(n, sample);
+
+    std::vector<chunk_t> chunks;
+    chunks.push_back({first, first + timed, &packed, reducer, nullptr});
+
+    const auto start = std::chrono::steady_clock::now();
+    chunks[0].run();
+    const auto stop = std::chrono::steady_clock::now();
+
+    if constexpr (!std::is_void_v<R>) {
+        if (reducer->done(*chunks[0].acc)) {
+            return chunks;
+        }
+    }
+
+    const auto rest = n - timed;
+    if (rest == 0) {
+        return chunks;
+    }
+
+    const auto per = std::chrono::duration<double, std::nano>(stop - start).count() / double(timed);
+    const auto threads = size_t(pool.workers()) + 1;
+    const auto balanced = (rest + 4 * threads - 1) / (4 * threads);
+    const auto sized = per > 0 ? size_t(double(chunk_us) * 1000 / per) : rest;
+    const auto size = std::clamp<size_t>(sized, 1, balanced);
+    const auto count = (rest + size - 1) / size;
+
+    latch done(static_cast<uint32_t>(count));
+
+    chunks.reserve(count + 1);
+    for (size_t i = 0; i < count; i++) {
+        const auto f = first + timed + i * size;
+        chunks.push_back({f, f + std::min(size, rest - i * size), &packed, reducer, &done});
+    }
+
+    for (size_t i = 2; i <= count; i++) {
+        pool.submit(work_pool::task_t(&chunk_t::run, &chunks[i]));
+    }
+
+    chunks[1].run();
+    pool.help(done);
+
+    return chunks;
+}
+
+/// invoke_parallel
+///
+/// Calls every delegate in [first, last) with the same arguments, in
+/// chunks spread over pool and the calling thread, and returns once all
+/// calls are done. Delegates must be safe to call concurrently with
+/// each other; the order of calls is unspecified. Arguments are passed
+/// as invoke_as() does, so a reference parameter is the same caller's
+/// object in every chunk.
+///
+template<size_t chunk_us = 50, class D, class... A>
+void invoke_parallel(work_pool &pool, const D *first, const D *last, A&&... args)
+{ run_parallel<chunk_us, void>(pool, first, last, nullptr, args...); }
+
+/// invoke_parallel_reduce
+///
+/// As invoke_parallel, folding return values with a reducer from
+/// invoke.h. Each chunk reduces its own range, and the chunk results
+/// are folded in order, so the result is the one invoke_reduce would
+/// give for associative reducers. A chunk stops early when its own
+/// result is decided; other chunks still run.
+///
+template<size_t chunk_us = 50, class R, class D, class... A>
+auto invoke_parallel_reduce(work_pool &pool, const D *first, const D *last, R reducer, A&&... args)
+{
+    auto chunks = run_parallel<chunk_us>(pool, first, last, &reducer, args...);
+    auto acc = reducer.init();
+
+    for (auto &c : chunks) {
+        reducer.fold(acc, std::move(*c.acc));
+
+        if (reducer.done(acc)) {
+            break;
+        }
+    }
+
+    return acc;
+}
+
+#endif
@@ -0,0 +1,266 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file percpu.h
+///
+
+#ifndef BFPERCPU_H
+#define BFPERCPU_H
+
+#include "delegate.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/// percpu queues
+///
+/// One inbox of delegate<void> tasks per CPU, for threads pinned one per
+/// CPU that need to run work on each other's CPUs. An inbox is made of
+/// one single-producer, single-consumer ring per sending CPU, so posts
+/// never contend with each other and need no atomic read-modify-write.
+/// The producer and consumer indices of a ring live on separate cache
+/// lines, and each side caches the other's index.
+///
+/// post() writes the task into the ring but does not publish it. flush()
+/// publishes everything the sender posted since its last flush and
+/// signals each target CPU's eventfd once, however many tasks went to
+/// it. A consumer can poll drain(), or block in wait(), or add fd() to
+/// its own epoll set.
+///
+/// CPU numbers are indices in [0, cpus), not necessarily the kernel's
+/// numbering. Each sending CPU's calls to post() and flush() must come
+/// from one thread, as must each receiving CPU's drain() and wait().
+///
+class percpu_queues
+{
+public:
+    using task_t = delegate<void>;
+
+    /// @param cpus the number of CPUs
+    /// @param slots the capacity of each ring (rounded up to a power of two)
+    ///
+    percpu_queues(uint32_t cpus, uint32_t slots) :
+        m_cpus{cpus}
+    {
+        m_mask = 1;
+        while (m_mask < slots) {
+            m_mask <<= 1;
+        }
+        m_mask--;
+
+        m_rings = std::make_unique<ring[]>(size_t(cpus) * cpus);
+        m_senders = std::make_unique<sender[]>(cpus);
+        m_fds.resize(cpus, -1);
+
+        for (size_t i = 0; i < size_t(cpus) * cpus; i++) {
+            m_rings[i].slots = std::make_unique<slot[]>(m_mask + 1);
+        }
+
+        for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+            m_senders[cpu].dirty.reserve(cpus);
+            m_fds[cpu] = eventfd(0, EFD_CLOEXEC);
+
+            if (m_fds[cpu] < 0) {
+                const auto err = errno;
+                close_fds();
+                throw std::system_error(err, std::generic_category(), "percpu_queues");
+            }
+        }
+    }
+
+    ~percpu_queues()
+    {
+        for (uint32_t to = 0; to < m_cpus; to++) {
+            for (uint32_t from = 0; from < m_cpus; from++) {
+                auto &r = get(from, to);
+                for (auto i = r.tail.load(); i != r.head_local; i++) {
+                    at(r, i).~task_t();
+                }
+            }
+        }
+
+        close_fds();
+    }
+
+    percpu_queues(const percpu_queues &) = delete;
+    percpu_queues &operator=(const percpu_queues &) = delete;
+
+    /// Post
+    ///
+    /// Queues t to run on CPU to, sent from CPU from. The task becomes
+    /// visible at the sender's next flush().
+    ///
+    /// @return false if the ring is full; what was posted so far is then
+    ///     flushed so that the receiver can make room
+    ///
+    bool post(uint32_t from, uint32_t to, const task_t &t)
+    {
+        auto &r = get(from, to);
+
+        if (r.head_local - r.tail_cache > m_mask) {
+            r.tail_cache = r.tail.load(std::memory_order_acquire);
+            if (r.head_local - r.tail_cache > m_mask) {
+                flush(from);
+                return false;
+            }
+        }
+
+        new (&at(r, r.head_local)) task_t(t);
+
+        if (r.head_local++ == r.head.load(std::memory_order_relaxed)) {
+            m_senders[from].dirty.push_back(to);
+        }
+
+        return true;
+    }
+
+    /// Flush
+    ///
+    /// Publishes the tasks CPU from has posted and wakes each CPU they
+    /// went to, one eventfd write per target.
+    ///
+    /// @return the number of wakeups sent
+    ///
+    size_t flush(uint32_t from) noexcept
+    {
+        auto &s = m_senders[from];
+        const auto n = s.dirty.size();
+
+        for (const auto to : s.dirty) {
+            auto &r = get(from, to);
+            r.head.store(r.head_local, std::memory_order_release);
+
+            const uint64_t one = 1;
+            [[maybe_unused]] auto ret = write(m_fds[to], &one, sizeof(one));
+        }
+
+        s.dirty.clear();
+        return n;
+    }
+
+    /// Drain
+    ///
+    /// Runs the tasks published to CPU to, from every sender.
+    ///
+    /// @return the number of tasks run
+    ///
+    size_t drain(uint32_t to)
+    {
+        size_t n = 0;
+
+        for (uint32_t from = 0; from < m_cpus; from++) {
+            auto &r = get(from, to);
+            const auto tail = r.tail.load(std::memory_order_relaxed);
+
+            if (r.head_cache == tail) {
+                r.head_cache = r.head.load(std::memory_order_acquire);
+            }
+
+            for (auto i = tail; i != r.head_cache; i++) {
+                auto &t = at(r, i);
+                t();
+                t.~task_t();
+            }
+
+            n += r.head_cache - tail;
+            r.tail.store(r.head_cache, std::memory_order_release);
+        }
+
+        return n;
+    }
+
+    /// Wait
+    ///
+    /// Blocks until CPU to has been sent a wakeup, then drains it.
+    ///
+    size_t wait(uint32_t to)
+    {
+        uint64_t count;
+        [[maybe_unused]] auto ret = read(m_fds[to], &count, sizeof(count));
+
+        return drain(to);
+    }
+
+    /// The eventfd signalled when CPU to has work
+    ///
+    int fd(uint32_t to) const noexcept
+    { return m_fds[to]; }
+
+    uint32_t cpus() const noexcept
+    { return m_cpus; }
+
+private:
+    struct slot
+    {
+        alignas(task_t) uint8_t buf[sizeof(task_t)];
+    };
+
+    struct ring
+    {
+        alignas(64) std::atomic<uint32_t> head{};
+        uint32_t head_local{};
+        uint32_t tail_cache{};
+
+        alignas(64) std::atomic<uint32_t> tail{};
+        uint32_t head_cache{};
+
+        alignas(64) std::unique_ptr<slot[]> slots;
+    };
+
+    struct alignas(64) sender
+    {
+        std::vector<uint32_t> dirty;
+    };
+
+    ring &get(uint32_t from, uint32_t to) noexcept
+    { return m_rings[size_t(to) * m_cpus + from]; }
+
+    task_t &at(ring &r, uint32_t i) noexcept
+    { return *std::launder(reinterpret_cast<task_t *>(r.slots[i & m_mask].buf)); }
+
+    void close_fds() noexcept
+    {
+        for (const auto fd : m_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    uint32_t m_cpus;
+    uint32_t m_mask;
+
+    std::unique_ptr<ring[]> m_rings;
+    std::unique_ptr<sender[]> m_senders;
+    std::vector<int> m_fds;
+};
+
+#endif
@@ -0,0 +1,221 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file reactor.h
+///
+
+#ifndef BFREACTOR_H
+#define BFREACTOR_H
+
+#include "delegate.h"
+
+#include <cstdint>
+#include <memory>
+#include <new>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/// reactor
+///
+/// A small epoll loop that dispatches readiness to one delegate per fd.
+/// Handlers live in a dense array indexed by fd, and the event's data
+/// carries the fd and the slot's generation, so dispatch is an array
+/// index and a compare with no hashing. All memory is allocated up
+/// front; adding and removing handlers never allocates.
+///
+/// Handlers may add and remove any fd, including their own, while
+/// being dispatched. Events still pending in the current batch for a
+/// removed (or removed and re-added) fd are dropped.
+///
+class reactor
+{
+public:
+    using handler_t = delegate<void, int, uint32_t>;
+
+    /// @param max_fds fds must be smaller than this to be added
+    /// @param batch the maximum number of events handled per poll
+    ///
+    explicit reactor(int max_fds, int batch = 256) :
+        m_slots{std::make_unique<slot[]>(static_cast<size_t>(max_fds))},
+        m_events{std::make_unique<epoll_event[]>(static_cast<size_t>(batch))},
+        m_max_fds{max_fds},
+        m_batch{batch},
+        m_epfd{epoll_create1(EPOLL_CLOEXEC)}
+    {
+        if (m_epfd < 0) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ~reactor()
+    {
+        for (int fd = 0; fd < m_max_fds; fd++) {
+            if (m_slots[fd].used) {
+                m_slots[fd].get().~handler_t();
+            }
+        }
+
+        close(m_epfd);
+    }
+
+    reactor(const reactor &) = delete;
+    reactor &operator=(const reactor &) = delete;
+
+    /// Add
+    ///
+    /// Calls handler(fd, events) whenever fd is ready for any of events.
+    ///
+    /// @return false if fd is out of range, already added, or rejected
+    ///     by epoll_ctl (errno is set)
+    ///
+    bool add(int fd, uint32_t events, handler_t handler)
+    {
+        if (fd < 0 || fd >= m_max_fds || m_slots[fd].used) {
+            return false;
+        }
+
+        auto &s = m_slots[fd];
+        s.gen++;
+
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = (uint64_t{s.gen} << 32) | static_cast<uint32_t>(fd);
+
+        if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            return false;
+        }
+
+        if (fd == m_current) {
+            m_readded = std::move(handler);
+            m_current_readded = true;
+        }
+        else {
+            new (s.buf) handler_t(std::move(handler));
+        }
+
+        s.used = true;
+        return true;
+    }
+
+    /// Remove
+    ///
+    /// Stops watching fd and destroys its handler. If the handler is
+    /// the one currently running, it is destroyed once it returns, and
+    /// a handler added for fd in the meantime is only moved into the
+    /// slot then.
+    ///
+    bool remove(int fd)
+    {
+        if (fd < 0 || fd >= m_max_fds || !m_slots[fd].used) {
+            return false;
+        }
+
+        epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr);
+
+        auto &s = m_slots[fd];
+        s.used = false;
+        s.gen++;
+
+        if (fd != m_current) {
+            s.get().~handler_t();
+        }
+        else if (m_current_readded) {
+            m_readded = handler_t();
+            m_current_readded = false;
+        }
+        else {
+            m_current_removed = true;
+        }
+
+        return true;
+    }
+
+    /// Poll
+    ///
+    /// Waits up to timeout milliseconds (-1 blocks) and dispatches one
+    /// batch of ready events.
+    ///
+    /// @return the number of events received, or -1 on error
+    ///
+    int poll(int timeout)
+    {
+        const auto n = epoll_wait(m_epfd, m_events.get(), m_batch, timeout);
+
+        for (int i = 0; i < n; i++) {
+            if (i + 1 < n) {
+                __builtin_prefetch(&m_slots[static_cast<uint32_t>(m_events[i + 1].data.u64)]);
+            }
+
+            const auto fd = static_cast<int>(static_cast<uint32_t>(m_events[i].data.u64));
+            const auto gen = static_cast<uint32_t>(m_events[i].data.u64 >> 32);
+            auto &s = m_slots[fd];
+
+            if (!s.used || s.gen != gen) {
+                continue;
+            }
+
+            m_current = fd;
+            s.get()(int(fd), uint32_t(m_events[i].events));
+            m_current = -1;
+
+            if (m_current_removed) {
+                m_current_removed = false;
+                s.get().~handler_t();
+
+                if (m_current_readded) {
+                    m_current_readded = false;
+                    new (s.buf) handler_t(std::move(m_readded));
+                    m_readded = handler_t();
+                }
+            }
+        }
+
+        return n;
+    }
+
+private:
+    struct slot
+    {
+        alignas(handler_t) uint8_t buf[sizeof(handler_t)];
+        uint32_t gen;
+        bool used;
+
+        handler_t &get() noexcept
+        { return *std::launder(reinterpret_cast<handler_t *>(buf)); }
+    };
+
+    std::unique_ptr<slot[]> m_slots;
+    std::unique_ptr<epoll_event[]> m_events;
+
+    int m_max_fds;
+    int m_batch;
+    int m_epfd;
+
+    int m_current{-1};
+    bool m_current_removed{};
+    bool m_current_readded{};
+    handler_t m_readded;
+};
+
+#endif
@@ -0,0 +1,529 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file shmqueue.h
+///
+
+#ifndef BFSHMQUEUE_H
+#define BFSHMQUEUE_H
+
+#include "delegate.h"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// payload layout
+///
+/// Where each argument of a call lives inside a record's payload. The
+/// arguments are laid out like the members of a struct.
+///
+template<class... A>
+struct payload_layout
+{
+    static constexpr auto compute()
+    {
+        std::array<size_t, sizeof...(A) + 1> r{};
+        size_t off = 0;
+        size_t i = 0;
+
+        ((off = (off + alignof(A) - 1) / alignof(A) * alignof(A),
+          r[i++] = off,
+          off += sizeof(A)), ...);
+
+        r[i] = off;
+        return r;
+    }
+
+    static constexpr auto offsets = compute();
+    static constexpr size_t size = offsets[sizeof...(A)];
+};
+
+/// doorbell
+///
+/// Lets one side of a shm_queue sleep until the other side rings. The
+/// flag is a futex shared between processes; ringing costs a fence and
+/// a load unless somebody is actually asleep.
+///
+class doorbell
+{
+public:
+    /// Sleeps until rung, unless ready() is already true once the
+    /// sleeping flag is visible to the ringer.
+    ///
+    template<class Ready>
+    void wait(Ready ready) noexcept
+    {
+        m_sleeping.store(1, std::memory_order_seq_cst);
+
+        if (!ready()) {
+            syscall(SYS_futex, &m_sleeping, FUTEX_WAIT, 1, nullptr, nullptr, 0);
+        }
+
+        m_sleeping.store(0, std::memory_order_relaxed);
+    }
+
+    /// Wakes the other side if it is asleep. Must follow the store that
+    /// makes it ready.
+    ///
+    void ring() noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_sleeping.load(std::memory_order_relaxed) != 0) {
+            m_sleeping.store(0, std::memory_order_relaxed);
+            syscall(SYS_futex, &m_sleeping, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+    }
+
+private:
+    std::atomic<uint32_t> m_sleeping;
+};
+
+static_assert(sizeof(doorbell) == sizeof(uint32_t));
+
+/// call id
+///
+/// The id of a registered delegate, typed by its arguments so that a
+/// producer cannot enqueue arguments the consumer would misread.
+///
+template<class... Args>
+struct call_id
+{
+    uint32_t id;
+};
+
+/// call registry
+///
+/// Assigns ids to delegates in registration order. Producer and
+/// consumer must register the same targets in the same order (for
+/// example by registering before forking), which makes the ids stable
+/// across processes. The delegates themselves never leave the process
+/// that registered them; only ids and arguments cross the queue.
+///
+class call_registry
+{
+public:
+    static constexpr size_t payload_size = 56;
+    static constexpr size_t payload_align = 8;
+
+    explicit call_registry(uint32_t capacity) :
+        m_entries{std::make_unique<entry[]>(capacity)},
+        m_capacity{capacity}
+    {}
+
+    ~call_registry()
+    {
+        for (uint32_t i = 0; i < m_size; i++) {
+            m_entries[i].destroy(m_entries[i].buf);
+        }
+    }
+
+    call_registry(const call_registry &) = delete;
+    call_registry &operator=(const call_registry &) = delete;
+
+    /// Add
+    ///
+    /// Registers d and returns its id. The arguments must be trivially
+    /// copyable and fit in a record's payload.
+    ///
+    template<class... Args>
+    call_id<Args...> add(delegate<void, Args...> d)
+    {
+        using layout = payload_layout<std::decay_t<Args>...>;
+        using delegate_t = delegate<void, Args...>;
+
+        static_assert((std::is_trivially_copyable_v<std::decay_t<Args>> && ...),
+            "call_registry: arguments must be trivially copyable");
+        static_assert(((alignof(std::decay_t<Args>) <= payload_align) && ...),
+            "call_registry: argument alignment is too large");
+        static_assert(layout::size <= payload_size,
+            "call_registry: arguments do not fit in a record");
+        static_assert(sizeof(delegate_t) <= sizeof(entry::buf));
+
+        if (m_size == m_capacity) {
+            throw std::bad_alloc();
+        }
+
+        auto &e = m_entries[m_size];
+
+        new (e.buf) delegate_t(std::move(d));
+        e.invoke = &s_invoke<Args...>;
+        e.destroy = &s_destroy<Args...>;
+
+        return {m_size++};
+    }
+
+    /// Invoke
+    ///
+    /// Calls delegate id with the arguments stored in payload. Arguments
+    /// taken by const reference are bound to the payload directly.
+    ///
+    /// @return false, without calling anything, if id is not registered
+    ///     (ids are read from memory the other process can write)
+    ///
+    bool invoke(uint32_t id, const uint8_t *payload) const
+    {
+        if (id >= m_size) {
+            return false;
+        }
+
+        const auto &e = m_entries[id];
+        e.invoke(e.buf, payload);
+
+        return true;
+    }
+
+    /// The number of registered delegates
+    ///
+    uint32_t size() const noexcept
+    { return m_size; }
+
+private:
+    struct entry
+    {
+        alignas(64) uint8_t buf[64];
+        void (*invoke)(const uint8_t *d, const uint8_t *payload);
+        void (*destroy)(uint8_t *d);
+    };
+
+    template<class... Args>
+    static void s_invoke(const uint8_t *d, const uint8_t *payload)
+    {
+        using layout = payload_layout<std::decay_t<Args>...>;
+
+        s_call<Args...>(
+            *std::launder(reinterpret_cast<const delegate<void, Args...> *>(d)),
+            payload, layout::offsets, std::index_sequence_for<Args...>{});
+    }
+
+    template<class... Args, size_t... I>
+    static void s_call(
+        const delegate<void, Args...> &d, [[maybe_unused]] const uint8_t *payload,
+        const std::array<size_t, sizeof...(Args) + 1> &offsets,
+        std::index_sequence<I...>)
+    {
+        d(static_cast<Args>(*reinterpret_cast<const std::decay_t<Args> *>(
+            payload + offsets[I]))...);
+    }
+
+    template<class... Args>
+    static void s_destroy(uint8_t *d)
+    { std::launder(reinterpret_cast<delegate<void, Args...> *>(d))->~delegate(); }
+
+    std::unique_ptr<entry[]> m_entries;
+    uint32_t m_capacity;
+    uint32_t m_size{};
+};
+
+/// shm queue
+///
+/// A single-producer, single-consumer ring of (id, arguments) records
+/// in a shared memory segment. The producer and consumer indices live
+/// on separate cache lines, and each side caches the other's index so
+/// that it only reads the shared one when the ring looks full (or
+/// empty).
+///
+/// Both sides are expected to poll. When polling finds nothing to do
+/// for a while, the consumer can wait_data() and the producer
+/// wait_space(); the other side then has to notify after pushing or
+/// draining. That is what makes the queue usable when producer and
+/// consumer share a core.
+///
+/// The segment is either anonymous (memfd, shared with children across
+/// fork or by passing the fd) or named (shm_open, opened by name from
+/// unrelated processes).
+///
+class shm_queue
+{
+public:
+    struct alignas(64) record
+    {
+        uint32_t id;
+        uint32_t reserved;
+        alignas(call_registry::payload_align) uint8_t payload[call_registry::payload_size];
+    };
+
+    static_assert(sizeof(record) == 64);
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    /// Create
+    ///
+    /// Creates a segment with room for slots records (rounded up to a
+    /// power of two). If name is null the segment is anonymous.
+    ///
+    static shm_queue create(size_t slots, const char *name = nullptr)
+    {
+        size_t n = 1;
+        while (n < slots) {
+            n <<= 1;
+        }
+
+        const auto bytes = sizeof(header) + n * sizeof(record);
+        const auto fd = name == nullptr ?
+            memfd_create("shm_queue", MFD_CLOEXEC) :
+            shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_queue");
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            const auto err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "shm_queue");
+        }
+
+        shm_queue q(fd, n - 1);
+        new (q.m_hdr) header{};
+        q.m_hdr->mask = q.m_mask;
+
+        return q;
+    }
+
+    /// Open
+    ///
+    /// Maps an existing named segment.
+    ///
+    static shm_queue open(const char *name)
+    {
+        const auto fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_queue");
+        }
+
+        header hdr;
+        struct stat st;
+
+        if (pread(fd, &hdr.mask, sizeof(hdr.mask), offsetof(header, mask)) !=
+                sizeof(hdr.mask) ||
+            ((hdr.mask + 1) & hdr.mask) != 0 || fstat(fd, &st) != 0 ||
+            static_cast<uint64_t>(st.st_size) < sizeof(header) ||
+            (static_cast<uint64_t>(st.st_size) - sizeof(header)) / sizeof(record) <
+                hdr.mask + 1) {
+            close(fd);
+            throw std::system_error(EINVAL, std::generic_category(), "shm_queue");
+        }
+
+        return shm_queue(fd, hdr.mask);
+    }
+
+    /// Unlink
+    ///
+    /// Removes a named segment. Processes that have it open keep it.
+    ///
+    static void unlink(const char *name) noexcept
+    { shm_unlink(name); }
+
+    shm_queue(shm_queue &&other) noexcept :
+        m_hdr{other.m_hdr},
+        m_mask{other.m_mask},
+        m_bytes{other.m_bytes},
+        m_fd{other.m_fd}
+    {
+        other.m_hdr = nullptr;
+        other.m_fd = -1;
+    }
+
+    shm_queue(const shm_queue &) = delete;
+    shm_queue &operator=(const shm_queue &) = delete;
+    shm_queue &operator=(shm_queue &&) = delete;
+
+    ~shm_queue()
+    {
+        if (m_hdr != nullptr) {
+            munmap(m_hdr, m_bytes);
+        }
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    /// The segment's fd, e.g. to pass to another process
+    ///
+    int fd() const noexcept
+    { return m_fd; }
+
+    /// Push
+    ///
+    /// Enqueues a call to id with vals. Producer side only.
+    ///
+    /// @return false if the ring is full
+    ///
+    template<class... Args, class... V>
+    bool push(call_id<Args...> id, const V&... vals) noexcept
+    {
+        static_assert(sizeof...(Args) == sizeof...(V));
+
+        const auto head = m_hdr->head.load(std::memory_order_relaxed);
+        if (head - m_tail_cache > m_mask) {
+            m_tail_cache = m_hdr->tail.load(std::memory_order_acquire);
+            if (head - m_tail_cache > m_mask) {
+                return false;
+            }
+        }
+
+        auto &r = slot(head);
+        r.id = id.id;
+        write<std::decay_t<Args>...>(r.payload, std::index_sequence_for<Args...>{}, vals...);
+
+        m_hdr->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Drain
+    ///
+    /// Invokes up to max queued calls through registry, in order, on
+    /// the records in place. Records with an unregistered id are
+    /// skipped. Consumer side only.
+    ///
+    /// The head index lives in the shared segment, so at most one ring's
+    /// worth of records is taken from it, whatever it says; a corrupt
+    /// head cannot make the consumer replay stale records.
+    ///
+    /// @return the number of calls made
+    ///
+    size_t drain(const call_registry &registry, size_t max = SIZE_MAX)
+    {
+        const auto tail = m_hdr->tail.load(std::memory_order_relaxed);
+
+        if (m_head_cache == tail) {
+            m_head_cache = m_hdr->head.load(std::memory_order_acquire);
+        }
+
+        auto n = static_cast<size_t>(m_head_cache - tail);
+        n = n <= m_mask ? n : static_cast<size_t>(m_mask + 1);
+        n = n < max ? n : max;
+
+        size_t calls = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            const auto &r = slot(tail + i);
+            calls += registry.invoke(r.id, r.payload);
+        }
+
+        m_hdr->tail.store(tail + n, std::memory_order_release);
+        return calls;
+    }
+
+    /// Wait data
+    ///
+    /// Blocks the consumer until the ring is not empty.
+    ///
+    void wait_data() noexcept
+    {
+        const auto tail = m_hdr->tail.load(std::memory_order_relaxed);
+        m_hdr->data.wait([&] { return m_hdr->head.load() != tail; });
+    }
+
+    /// Wait space
+    ///
+    /// Blocks the producer until the ring is not full.
+    ///
+    void wait_space() noexcept
+    {
+        const auto head = m_hdr->head.load(std::memory_order_relaxed);
+        m_hdr->space.wait([&] { return head - m_hdr->tail.load() <= m_mask; });
+    }
+
+    /// Notify data
+    ///
+    /// Wakes the consumer if it waits for data. Producer side, after one
+    /// or more pushes.
+    ///
+    void notify_data() noexcept
+    { m_hdr->data.ring(); }
+
+    /// Notify space
+    ///
+    /// Wakes the producer if it waits for space. Consumer side, after a
+    /// drain.
+    ///
+    void notify_space() noexcept
+    { m_hdr->space.ring(); }
+
+private:
+    struct header
+    {
+        alignas(64) std::atomic<uint64_t> head;
+        doorbell data;
+        alignas(64) std::atomic<uint64_t> tail;
+        doorbell space;
+        alignas(64) uint64_t mask;
+    };
+
+    shm_queue(int fd, uint64_t mask) :
+        m_mask{mask},
+        m_bytes{sizeof(header) + (mask + 1) * sizeof(record)},
+        m_fd{fd}
+    {
+        auto ptr = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            const auto err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "shm_queue");
+        }
+
+        m_hdr = static_cast<header *>(ptr);
+    }
+
+    record &slot(uint64_t i) const noexcept
+    {
+        auto records = reinterpret_cast<record *>(m_hdr + 1);
+        return records[i & m_mask];
+    }
+
+    template<class... T, size_t... I, class... V>
+    static void write([[maybe_unused]] uint8_t *payload, std::index_sequence<I...>, const V&... vals) noexcept
+    {
+        using layout = payload_layout<T...>;
+        (new (payload + layout::offsets[I]) T(vals), ...);
+    }
+
+    header *m_hdr{};
+
+    // The ring size as mapped. The copy in the header is only read by
+    // open(): a peer that rewrites it cannot move slot() outside the
+    // mapping.
+    uint64_t m_mask;
+    size_t m_bytes;
+    int m_fd;
+
+    uint64_t m_tail_cache{};
+    uint64_t m_head_cache{};
+};
+
+#endif
@@ -1,8 +1,15 @@
 #include "delegate.h"
+#include "compact.h"
+#include "trampoline.h"
+#include "weak.h"
+#include "numa.h"
 #include <iostream>
 #include <typeinfo>
 #include <unistd.h>
 #include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 int foo()
 {
@@ -18,9 +25,30 @@ struct bar {
     bar() : val{rand() % 8} {}
     int baz() { return rand() % 2; }
     int fiz() const { return val + (rand() % 2); }
+    int &ref() { return val; }
     int val;
 };
 
+int add3(int a, int b, int c)
+{
+    return a + b + c;
+}
+
+int deref(std::unique_ptr<int> &p, int n)
+{
+    return *p * n;
+}
+
+struct order {
+    bool desc;
+    int cmp(const void *l, const void *r) const
+    {
+        const auto a = *static_cast<const int *>(l);
+        const auto b = *static_cast<const int *>(r);
+        return desc ? b - a : a - b;
+    }
+};
+
 struct bell : public bar {
     bell() : bar() {}
     int f0() { return rand() % 2; }
@@ -53,6 +81,86 @@ int main()
     static_assert(std::is_same_v<decltype(fizd), delegate<int>>);
     static_assert(std::is_same_v<decltype(cizm), delegate<int>>);
 
+    auto addd = bind_front(&add3, 1, 2);
+    auto fizb = bind_front(&bar::fiz, &c);
+    auto ptrd = bind_front(&deref, std::make_unique<int>(3));
+    auto ptrm = std::move(ptrd);
+
+    static_assert(std::is_same_v<decltype(addd), delegate<int, int>>);
+    static_assert(std::is_same_v<decltype(fizb), delegate<int>>);
+    static_assert(std::is_same_v<decltype(ptrm), delegate<int, int>>);
+    static_assert(std::is_nothrow_move_constructible_v<delegate<int, int>>);
+
+    std::vector<delegate<int, int>> ptrs;
+    for (int i = 0; i < 8; i++) {
+        ptrs.push_back(bind_front(&deref, std::make_unique<int>(i)));
+    }
+
+    auto copy_threw = false;
+    try {
+        auto ptrc = ptrs[0];
+    }
+    catch (const std::logic_error &) {
+        copy_threw = true;
+    }
+
+    auto pipe = then(addd, &biz);
+    auto comp = compose(&biz, &foo);
+
+    static_assert(std::is_same_v<decltype(pipe), delegate<int, int>>);
+    static_assert(std::is_same_v<decltype(comp), delegate<int>>);
+
+    trampoline_pool pool;
+    const order down{true};
+
+    int nums[] = {3, 1, 4, 1, 5, 9, 2, 6};
+    trampoline cmpt(pool, delegate(&order::cmp, &down));
+    qsort(nums, 8, sizeof(int), cmpt.get());
+
+    compact_delegate cbaz(&bar::baz, &b);
+    auto cbiz = compact_delegate(&biz);
+
+    static_assert(std::is_same_v<decltype(cbaz), compact_delegate<int>>);
+    static_assert(std::is_same_v<decltype(cbiz), compact_delegate<int, int>>);
+
+    auto rebd = food;
+    rebd.rebind(&bar::fiz, &c);
+    bizc = bizd;
+
+    weak_table weaks(16);
+    auto wref = weaks.attach(&b);
+    auto weakd = bind_weak(wref, &bar::fiz);
+    auto weakr = bind_weak(wref, &bar::ref);
+    auto weakv = weakd();
+    weaks.invalidate(wref);
+
+    auto weakr_threw = false;
+    try {
+        weakr();
+    }
+    catch (const std::bad_function_call &) {
+        weakr_threw = true;
+    }
+
+    const auto same = bazd == delegate(&bar::baz, &b);
+    const auto diff = bazd == delegate(&bar::baz, static_cast<bar *>(&h));
+    const auto hash = std::hash<delegate<int>>{}(bazd) == std::hash<delegate<int>>{}(bazd);
+
+    delegate<int, int> none;
+    const auto set = bool(bizd);
+
+    auto noref_threw = false;
+    try {
+        delegate<std::unique_ptr<int> &, int>()(0);
+    }
+    catch (const std::bad_function_call &) {
+        noref_threw = true;
+    }
+
+    replicated_table<int, int> table(4, bizd, 2);
+    table.set(1, addd);
+    table.reclaim();
+
     printf("bizd(2) == %d, sizeof == %lu\n", bizd(2), sizeof(bizd));
     printf("bizc(2) == %d, sizeof == %lu\n", bizc(2), sizeof(bizc));
     printf("food() == %d, sizeof == %lu\n", food(), sizeof(food));
@@ -60,4 +168,22 @@ int main()
     printf("beld() == %d, sizeof == %lu\n", beld(), sizeof(beld));
     printf("fizd() == %d, sizeof == %lu\n", fizd(), sizeof(fizd));
     printf("cizm() == %d, sizeof == %lu\n", cizm(), sizeof(cizm));
+    printf("addd(3) == %d, sizeof == %lu\n", addd(3), sizeof(addd));
+    printf("fizb() == %d, sizeof == %lu\n", fizb(), sizeof(fizb));
+    printf("ptrm(2) == %d, sizeof == %lu\n", ptrm(2), sizeof(ptrm));
+    printf("ptrs[7](2) == %d, copying a move-only delegate throws: %d\n", ptrs[7](2), copy_threw);
+    printf("pipe(3) == %d, sizeof == %lu\n", pipe(3), sizeof(pipe));
+    printf("comp() == %d, sizeof == %lu\n", comp(), sizeof(comp));
+    printf("cbaz() == %d, sizeof == %lu\n", cbaz(), sizeof(cbaz));
+    printf("cbiz(2) == %d, sizeof == %lu\n", cbiz(2), sizeof(cbiz));
+    printf("rebd() == %d, sizeof == %lu\n", rebd(), sizeof(rebd));
+    printf("weakd() == %d then %d, sizeof == %lu\n", weakv, weakd(), sizeof(weakd));
+    printf("dead weak reference call throws: %d\n", weakr_threw);
+    printf("bazd == copy: %d, bazd == other: %d, equal hashes: %d\n", same, diff, hash);
+    printf("none(2) == %d, empty: %d, bizd empty: %d, empty reference call throws: %d\n",
+        none(2), !none, !set, noref_threw);
+    printf("table(1, 3) == %d, replica 1: %d, %u system nodes\n",
+        table(1, 3), table.replica(1, 1)(3), numa_topology::system().nodes());
+    printf("qsort(cmpt) == %d %d %d %d %d %d %d %d\n",
+        nums[0], nums[1], nums[2], nums[3], nums[4], nums[5], nums[6], nums[7]);
 }
@@ -0,0 +1,325 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file trampoline.h
+///
+
+#ifndef BFTRAMPOLINE_H
+#define BFTRAMPOLINE_H
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "trampoline.h is only supported on x86-64 Linux"
+#endif
+
+#include "delegate.h"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/// trampoline pool
+///
+/// Hands out small pieces of executable code that turn a plain C
+/// function call into a call on a context pointer. Each trampoline
+/// shifts the integer argument registers up by one, loads its context
+/// into rdi and jumps to an entry function, so the entry sees
+/// entry(ctx, args...) while the caller only saw fn(args...).
+///
+/// Code lives in a memfd that is mapped twice: once read/write, where
+/// trampolines are written, and once read/execute, where they are
+/// called. No page is ever writable and executable at the same time,
+/// and writing a new trampoline never changes the protection of pages
+/// that other threads may be executing. Slots are allocated in chunks
+/// and recycled through a free list, so only growing the pool makes a
+/// system call.
+///
+class trampoline_pool
+{
+public:
+    static constexpr size_t code_size = 64;
+    static constexpr size_t data_size = 64;
+
+    /// slot
+    ///
+    /// One trampoline: the code that callers jump to, and data_size bytes
+    /// of context storage whose address the code passes to the entry.
+    ///
+    struct slot
+    {
+        alignas(data_size) uint8_t data[data_size];
+        void *code_rw;
+        void *code_rx;
+        slot *next;
+    };
+
+    explicit trampoline_pool(size_t n = 0)
+    { reserve(n); }
+
+    ~trampoline_pool()
+    {
+        for (const auto &c : m_chunks) {
+            munmap(c.rw, c.bytes);
+            munmap(c.rx, c.bytes);
+        }
+    }
+
+    trampoline_pool(const trampoline_pool &) = delete;
+    trampoline_pool &operator=(const trampoline_pool &) = delete;
+
+    /// Reserve
+    ///
+    /// Makes sure at least n slots can be allocated without growing the
+    /// pool again. All of them are mapped in a single chunk.
+    ///
+    void reserve(size_t n)
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (n > m_free) {
+            grow(n - m_free);
+        }
+    }
+
+    /// Allocate
+    ///
+    /// Writes a trampoline that calls entry(data, args...) and returns its
+    /// slot. The caller constructs the context in slot->data.
+    ///
+    slot *allocate(const void *entry)
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (m_head == nullptr) {
+            grow(m_chunks.empty() ? slots_per_page : m_capacity);
+        }
+
+        auto s = m_head;
+        m_head = s->next;
+        m_free--;
+
+        write(s, entry);
+        return s;
+    }
+
+    /// Free
+    ///
+    /// Returns a slot to the free list. The trampoline must no longer be
+    /// called.
+    ///
+    void free(slot *s) noexcept
+    {
+        std::lock_guard lock(m_mutex);
+
+        s->next = m_head;
+        m_head = s;
+        m_free++;
+    }
+
+private:
+    static constexpr size_t page_size = 0x1000;
+    static constexpr size_t slots_per_page = page_size / code_size;
+
+    struct chunk
+    {
+        void *rw;
+        void *rx;
+        size_t bytes;
+        std::unique_ptr<slot[]> slots;
+    };
+
+    void grow(size_t n)
+    {
+        n = (n + slots_per_page - 1) / slots_per_page * slots_per_page;
+        const auto bytes = n * code_size;
+
+        const auto fd = memfd_create("trampolines", MFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::bad_alloc();
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            close(fd);
+            throw std::bad_alloc();
+        }
+
+        auto rw = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        auto rx = mmap(nullptr, bytes, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (rw == MAP_FAILED || rx == MAP_FAILED) {
+            if (rw != MAP_FAILED) {
+                munmap(rw, bytes);
+            }
+            if (rx != MAP_FAILED) {
+                munmap(rx, bytes);
+            }
+            throw std::bad_alloc();
+        }
+
+        chunk c{rw, rx, bytes, std::make_unique<slot[]>(n)};
+
+        for (size_t i = n; i-- > 0;) {
+            auto &s = c.slots[i];
+
+            s.code_rw = static_cast<uint8_t *>(rw) + i * code_size;
+            s.code_rx = static_cast<uint8_t *>(rx) + i * code_size;
+            s.next = m_head;
+            m_head = &s;
+        }
+
+        m_chunks.emplace_back(std::move(c));
+        m_capacity += n;
+        m_free += n;
+    }
+
+    static void write(slot *s, const void *entry) noexcept
+    {
+        static const uint8_t shift[] = {
+            0x4D, 0x89, 0xC1,       // mov r9, r8
+            0x49, 0x89, 0xC8,       // mov r8, rcx
+            0x48, 0x89, 0xD1,       // mov rcx, rdx
+            0x48, 0x89, 0xF2,       // mov rdx, rsi
+            0x48, 0x89, 0xFE,       // mov rsi, rdi
+        };
+
+        auto code = static_cast<uint8_t *>(s->code_rw);
+        auto data = static_cast<const void *>(s->data);
+
+        memset(code, 0xCC, code_size);
+        memcpy(code, shift, sizeof(shift));
+        code += sizeof(shift);
+
+        *code++ = 0x48;             // movabs rdi, data
+        *code++ = 0xBF;
+        memcpy(code, &data, sizeof(data));
+        code += sizeof(data);
+
+        *code++ = 0x49;             // movabs r11, entry
+        *code++ = 0xBB;
+        memcpy(code, &entry, sizeof(entry));
+        code += sizeof(entry);
+
+        *code++ = 0x41;             // jmp r11
+        *code++ = 0xFF;
+        *code++ = 0xE3;
+    }
+
+    std::mutex m_mutex;
+    std::vector<chunk> m_chunks;
+    slot *m_head{};
+    size_t m_capacity{};
+    size_t m_free{};
+};
+
+/// Types that are passed in a single general purpose or SSE register
+///
+template<class T>
+static constexpr bool is_register_arg_v =
+    (std::is_integral_v<T> || std::is_enum_v<T> || std::is_pointer_v<T> ||
+     std::is_same_v<T, float> || std::is_same_v<T, double>);
+
+template<class T>
+static constexpr bool is_gp_arg_v =
+    is_register_arg_v<T> && !std::is_floating_point_v<T>;
+
+/// trampoline
+///
+/// Owns a copy of a delegate and a native function pointer that calls
+/// it, e.g. to pass a bound member function to qsort or atexit. The
+/// function pointer stays valid until the trampoline is destroyed.
+///
+/// Arguments and return values must be scalars, and at most five of
+/// the arguments may be passed in general purpose registers, since the
+/// context takes up the first one.
+///
+template<class Ret, class... Args>
+class trampoline
+{
+    static_assert(((is_register_arg_v<Args>) && ...),
+        "trampoline: arguments must be integers, pointers, float or double");
+    static_assert(std::is_void_v<Ret> || is_register_arg_v<Ret>,
+        "trampoline: return type must be void or a scalar");
+    static_assert((0 + ... + (is_gp_arg_v<Args> ? 1 : 0)) <= 5,
+        "trampoline: at most five integer or pointer arguments are supported");
+
+    using delegate_t = delegate<Ret, Args...>;
+    static_assert(sizeof(delegate_t) <= trampoline_pool::data_size);
+
+public:
+    using fn_t = Ret(*)(Args...);
+
+    trampoline(trampoline_pool &pool, delegate_t d) :
+        m_pool{&pool},
+        m_slot{pool.allocate(reinterpret_cast<const void *>(&entry))}
+    { new (m_slot->data) delegate_t(std::move(d)); }
+
+    trampoline(trampoline &&other) noexcept :
+        m_pool{other.m_pool},
+        m_slot{other.m_slot}
+    { other.m_slot = nullptr; }
+
+    trampoline &operator=(trampoline &&other) noexcept
+    {
+        if (this != &other) {
+            this->~trampoline();
+            m_pool = other.m_pool;
+            m_slot = other.m_slot;
+            other.m_slot = nullptr;
+        }
+
+        return *this;
+    }
+
+    trampoline(const trampoline &) = delete;
+    trampoline &operator=(const trampoline &) = delete;
+
+    ~trampoline()
+    {
+        if (m_slot != nullptr) {
+            reinterpret_cast<delegate_t *>(m_slot->data)->~delegate_t();
+            m_pool->free(m_slot);
+        }
+    }
+
+    /// Returns the native function pointer
+    ///
+    fn_t get() const noexcept
+    { return reinterpret_cast<fn_t>(m_slot->code_rx); }
+
+private:
+    static Ret entry(const delegate_t *d, Args... args)
+    { return (*d)(std::forward<Args>(args)...); }
+
+    trampoline_pool *m_pool;
+    trampoline_pool::slot *m_slot;
+};
+
+template<class R, class... A>
+trampoline(trampoline_pool &, delegate<R, A...>) -> trampoline<R, A...>;
+
+#endif
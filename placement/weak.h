@@ -0,0 +1,194 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file weak.h
+///
+
+#ifndef BFWEAK_H
+#define BFWEAK_H
+
+#include "delegate.h"
+
+#include <cstdint>
+#include <memory>
+#include <new>
+
+/// weak table
+///
+/// A fixed-size table of generation-counted handles. An object attaches
+/// itself once and receives a weak_ref; delegates bound through that
+/// ref check the entry's generation before every call and do nothing
+/// once the object invalidates it, typically from its destructor.
+///
+/// Invalidating bumps the generation, which kills every delegate bound
+/// to the object at once. The check is a single plain compare, so the
+/// table is not thread-safe: invalidation must not race with calls.
+///
+class weak_table
+{
+public:
+    struct entry
+    {
+        void *obj;
+        uint32_t gen;
+        uint32_t next;
+    };
+
+    explicit weak_table(uint32_t size) :
+        m_entries{std::make_unique<entry[]>(size)},
+        m_size{size}
+    {
+        for (uint32_t i = 0; i < size; i++) {
+            m_entries[i] = {nullptr, 0, i + 1};
+        }
+    }
+
+    /// weak ref
+    ///
+    /// Names one attachment of an object to the table.
+    ///
+    template<class C>
+    struct ref
+    {
+        entry *e;
+        uint32_t gen;
+    };
+
+    /// Attach
+    ///
+    /// Registers obj and returns the ref to bind delegates through.
+    ///
+    template<class C>
+    ref<C> attach(C *obj)
+    {
+        if (m_head == m_size) {
+            throw std::bad_alloc();
+        }
+
+        auto e = &m_entries[m_head];
+        m_head = e->next;
+
+        e->obj = const_cast<void *>(static_cast<const void *>(obj));
+        return {e, e->gen};
+    }
+
+    /// Invalidate
+    ///
+    /// Kills every delegate bound through r and recycles its entry.
+    ///
+    template<class C>
+    void invalidate(const ref<C> &r) noexcept
+    {
+        auto e = r.e;
+        if (e->gen != r.gen) {
+            return;
+        }
+
+        e->obj = nullptr;
+        e->gen++;
+        e->next = m_head;
+        m_head = static_cast<uint32_t>(e - m_entries.get());
+    }
+
+    /// Alive
+    ///
+    /// @return true if r has not been invalidated
+    ///
+    template<class C>
+    static bool alive(const ref<C> &r) noexcept
+    { return r.e->gen == r.gen; }
+
+private:
+    std::unique_ptr<entry[]> m_entries;
+    uint32_t m_size;
+    uint32_t m_head{};
+};
+
+template<class C>
+using weak_ref = weak_table::ref<C>;
+
+/// weak memfn
+///
+/// The callable stored by bind_weak. Calls on a dead target are skipped
+/// and return a value-initialized Ret, or throw std::bad_function_call
+/// when Ret has no such value, as empty_target does.
+///
+/// The entry pointer, the generation (padded to 8) and the memfn take
+/// 32 bytes. That is exactly sizeof(state_t), the limit can_emplace
+/// checks: state_t is 24 bytes aligned to 32. A delegate is 64 bytes
+/// once its call and vtable pointers are added.
+///
+template<class C, class MemFn, class Ret>
+class weak_memfn
+{
+public:
+    weak_memfn(MemFn fn, const weak_ref<C> &r) :
+        m_entry{r.e},
+        m_gen{r.gen},
+        m_fn{fn}
+    {}
+
+    template<class... A>
+    Ret operator()(A&&... args) const
+    {
+        if (m_entry->gen != m_gen) {
+            if constexpr (s_returns) {
+                return Ret();
+            }
+            else {
+                throw std::bad_function_call();
+            }
+        }
+
+        return std::invoke(m_fn, static_cast<C *>(m_entry->obj), std::forward<A>(args)...);
+    }
+
+private:
+    static constexpr bool s_returns =
+        std::is_void_v<Ret> || std::is_default_constructible_v<Ret>;
+
+    const weak_table::entry *m_entry;
+    uint32_t m_gen;
+    MemFn m_fn;
+};
+
+/// bind_weak
+///
+/// Binds a member function to an object through its weak_ref. The
+/// resulting delegate has the same signature as the member function.
+///
+template<class C, class R, class... A>
+delegate<R, A...> bind_weak(const weak_ref<C> &r, R(C::*memfn)(A...))
+{
+    using F = weak_memfn<C, decltype(memfn), R>;
+    return delegate<R, A...>(std::in_place_type<F>, memfn, r);
+}
+
+template<class C, class R, class... A>
+delegate<R, A...> bind_weak(const weak_ref<C> &r, R(C::*memfn)(A...) const)
+{
+    using F = weak_memfn<const C, decltype(memfn), R>;
+    return delegate<R, A...>(std::in_place_type<F>, memfn, weak_ref<const C>{r.e, r.gen});
+}
+
+#endif
@@ -0,0 +1,701 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+///
+/// @file delegate.h
+///
+
+#ifndef BFDELEGATE_H
+#define BFDELEGATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// storage policies
+// -----------------------------------------------------------------------------
+
+/// inline storage
+///
+/// Callables are stored in a fixed-size buffer inside the delegate.
+/// Anything that does not fit is rejected at compile time.
+///
+template<size_t size = 24, size_t align = 8>
+struct inline_storage
+{
+    struct buffer
+    {
+        alignas(align) uint8_t data[size];
+    };
+
+    template<class F>
+    static constexpr bool fits = (sizeof(F) <= size) && (align % alignof(F) == 0);
+
+    template<class F>
+    static constexpr bool owns = fits<F>;
+
+    template<class F>
+    static constexpr bool trivial =
+        std::is_trivially_copyable_v<F> && std::is_trivially_destructible_v<F>;
+
+    template<class F>
+    static F &get(const buffer &buf) noexcept
+    { return *std::launder(reinterpret_cast<F *>(const_cast<uint8_t *>(buf.data))); }
+
+    template<class F, class G>
+    static void create(buffer &buf, G &&fn)
+    {
+        static_assert(fits<F>, "inline_storage: callable does not fit");
+        new (buf.data) F(std::forward<G>(fn));
+    }
+
+    template<class F>
+    static void copy(buffer &dst, const buffer &src)
+    { new (dst.data) F(get<F>(src)); }
+
+    template<class F>
+    static void move(buffer &dst, buffer &src) noexcept
+    { new (dst.data) F(std::move(get<F>(src))); }
+
+    template<class F>
+    static void destroy(buffer &buf) noexcept
+    { get<F>(buf).~F(); }
+};
+
+/// block pool
+///
+/// A free list of fixed-size blocks, carved out of larger chunks that
+/// are kept until the program exits.
+///
+template<size_t block>
+class block_pool
+{
+public:
+    static block_pool &instance()
+    {
+        static block_pool self;
+        return self;
+    }
+
+    void *allocate()
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (m_head == nullptr) {
+            grow();
+        }
+
+        auto n = m_head;
+        m_head = n->next;
+
+        return n;
+    }
+
+    void free(void *ptr) noexcept
+    {
+        std::lock_guard lock(m_mutex);
+
+        auto n = static_cast<node *>(ptr);
+        n->next = m_head;
+        m_head = n;
+    }
+
+private:
+    static constexpr size_t blocks_per_chunk = 64;
+
+    union node
+    {
+        node *next;
+        alignas(std::max_align_t) uint8_t data[block];
+    };
+
+    void grow()
+    {
+        m_chunks.emplace_back(new node[blocks_per_chunk]);
+
+        for (size_t i = 0; i < blocks_per_chunk; i++) {
+            auto n = &m_chunks.back()[i];
+            n->next = m_head;
+            m_head = n;
+        }
+    }
+
+    block_pool() = default;
+
+    ~block_pool()
+    {
+        for (auto c : m_chunks) {
+            delete[] c;
+        }
+    }
+
+    std::mutex m_mutex;
+    std::vector<node *> m_chunks;
+    node *m_head{};
+};
+
+/// pooled storage
+///
+/// Small callables are stored inline. Callables up to block bytes are
+/// placed in a block from a shared pool instead of being rejected, and
+/// only a pointer to them is kept inline.
+///
+template<size_t size = 24, size_t align = 8, size_t block = 128>
+struct pooled_storage
+{
+    using base = inline_storage<size, align>;
+    using buffer = typename base::buffer;
+
+    template<class F>
+    static constexpr bool is_inline = base::template fits<F>;
+
+    template<class F>
+    static constexpr bool fits = is_inline<F> ||
+        ((sizeof(F) <= block) && (alignof(F) <= alignof(std::max_align_t)));
+
+    template<class F>
+    static constexpr bool owns = fits<F>;
+
+    template<class F>
+    static constexpr bool trivial = is_inline<F> && base::template trivial<F>;
+
+    template<class F>
+    static F &get(const buffer &buf) noexcept
+    {
+        if constexpr (is_inline<F>) {
+            return base::template get<F>(buf);
+        }
+        else {
+            return *base::template get<F *>(buf);
+        }
+    }
+
+    template<class F, class G>
+    static void create(buffer &buf, G &&fn)
+    {
+        static_assert(fits<F>, "pooled_storage: callable does not fit in a block");
+
+        if constexpr (is_inline<F>) {
+            base::template create<F>(buf, std::forward<G>(fn));
+        }
+        else {
+            auto ptr = block_pool<block>::instance().allocate();
+            base::template create<F *>(buf, new (ptr) F(std::forward<G>(fn)));
+        }
+    }
+
+    template<class F>
+    static void copy(buffer &dst, const buffer &src)
+    {
+        if constexpr (is_inline<F>) {
+            base::template copy<F>(dst, src);
+        }
+        else {
+            create<F>(dst, get<F>(src));
+        }
+    }
+
+    template<class F>
+    static void move(buffer &dst, buffer &src) noexcept
+    {
+        if constexpr (is_inline<F>) {
+            base::template move<F>(dst, src);
+        }
+        else {
+            base::template create<F *>(dst, &get<F>(src));
+            base::template get<F *>(src) = nullptr;
+        }
+    }
+
+    template<class F>
+    static void destroy(buffer &buf) noexcept
+    {
+        if constexpr (is_inline<F>) {
+            base::template destroy<F>(buf);
+        }
+        else {
+            if (auto ptr = base::template get<F *>(buf)) {
+                ptr->~F();
+                block_pool<block>::instance().free(ptr);
+            }
+        }
+    }
+};
+
+/// ref storage
+///
+/// The delegate does not own its callable. Trivially copyable callables
+/// no larger than a pointer (function pointers, bind<>() results) are
+/// stored by value; anything else is referenced and must be an lvalue
+/// that outlives the delegate.
+///
+struct ref_storage
+{
+    struct buffer
+    {
+        void *ptr;
+    };
+
+    template<class F>
+    static constexpr bool by_value =
+        std::is_trivially_copyable_v<F> && (sizeof(F) <= sizeof(void *)) &&
+        (alignof(void *) % alignof(F) == 0);
+
+    template<class F>
+    static constexpr bool fits = true;
+
+    template<class F>
+    static constexpr bool owns = by_value<F>;
+
+    template<class F>
+    static constexpr bool trivial = true;
+
+    template<class F>
+    static F &get(const buffer &buf) noexcept
+    {
+        if constexpr (by_value<F>) {
+            return *std::launder(reinterpret_cast<F *>(const_cast<void **>(&buf.ptr)));
+        }
+        else {
+            return *static_cast<F *>(buf.ptr);
+        }
+    }
+
+    template<class F, class G>
+    static void create(buffer &buf, G &&fn)
+    {
+        if constexpr (by_value<F>) {
+            new (&buf.ptr) F(std::forward<G>(fn));
+        }
+        else {
+            static_assert(std::is_lvalue_reference_v<G>,
+                "ref_storage: only lvalue callables can be referenced");
+            buf.ptr = const_cast<void *>(static_cast<const void *>(std::addressof(fn)));
+        }
+    }
+
+    template<class F>
+    static void copy(buffer &dst, const buffer &src) noexcept
+    { dst = src; }
+
+    template<class F>
+    static void move(buffer &dst, buffer &src) noexcept
+    { dst = src; }
+
+    template<class F>
+    static void destroy(buffer &) noexcept
+    {}
+};
+
+// -----------------------------------------------------------------------------
+// dispatch policies
+// -----------------------------------------------------------------------------
+
+/// manager dispatch
+///
+/// Lifecycle operations go through a single manager function that
+/// switches on the operation, as std::function does. Costs one pointer.
+///
+struct manager_dispatch
+{
+    enum class op
+    {
+        copy,
+        move,
+        destroy
+    };
+
+    template<class Storage>
+    class ops
+    {
+        using buffer = typename Storage::buffer;
+        using manager_t = void(*)(op, buffer &, buffer *);
+
+    public:
+        template<class F>
+        static ops make() noexcept
+        { return ops(&manage<F>); }
+
+        void copy(buffer &dst, const buffer &src) const
+        { m_manager(op::copy, dst, const_cast<buffer *>(&src)); }
+
+        void move(buffer &dst, buffer &src) const noexcept
+        { m_manager(op::move, dst, &src); }
+
+        void destroy(buffer &buf) const noexcept
+        { m_manager(op::destroy, buf, nullptr); }
+
+    private:
+        explicit ops(manager_t manager) noexcept : m_manager{manager}
+        {}
+
+        template<class F>
+        static void manage(op o, buffer &dst, buffer *src)
+        {
+            switch (o) {
+                case op::copy:
+                    Storage::template copy<F>(dst, *src);
+                    break;
+                case op::move:
+                    Storage::template move<F>(dst, *src);
+                    break;
+                case op::destroy:
+                    Storage::template destroy<F>(dst);
+                    break;
+            }
+        }
+
+        manager_t m_manager;
+    };
+};
+
+/// vtable dispatch
+///
+/// Lifecycle operations go through a static table with one function per
+/// operation. Costs one pointer.
+///
+struct vtable_dispatch
+{
+    template<class Storage>
+    class ops
+    {
+        using buffer = typename Storage::buffer;
+
+        struct table
+        {
+            void (&copy)(buffer &dst, const buffer &src);
+            void (&move)(buffer &dst, buffer &src) noexcept;
+            void (&destroy)(buffer &buf) noexcept;
+        };
+
+    public:
+        template<class F>
+        static ops make() noexcept
+        {
+            static const table self = {
+                Storage::template copy<F>,
+                Storage::template move<F>,
+                Storage::template destroy<F>
+            };
+
+            return ops(&self);
+        }
+
+        void copy(buffer &dst, const buffer &src) const
+        { m_table->copy(dst, src); }
+
+        void move(buffer &dst, buffer &src) const noexcept
+        { m_table->move(dst, src); }
+
+        void destroy(buffer &buf) const noexcept
+        { m_table->destroy(buf); }
+
+    private:
+        explicit ops(const table *t) noexcept : m_table{t}
+        {}
+
+        const table *m_table;
+    };
+};
+
+/// trivial dispatch
+///
+/// No lifecycle operations at all: the buffer is copied bitwise and
+/// never destroyed. Only callables that the storage policy reports as
+/// trivial are accepted. Costs nothing.
+///
+struct trivial_dispatch
+{
+    template<class Storage>
+    class ops
+    {
+        using buffer = typename Storage::buffer;
+
+    public:
+        template<class F>
+        static ops make() noexcept
+        {
+            static_assert(Storage::template trivial<F>,
+                "trivial_dispatch: callable is not trivially copyable");
+
+            return {};
+        }
+
+        void copy(buffer &dst, const buffer &src) const noexcept
+        { dst = src; }
+
+        void move(buffer &dst, buffer &src) const noexcept
+        { dst = src; }
+
+        void destroy(buffer &) const noexcept
+        {}
+    };
+};
+
+// -----------------------------------------------------------------------------
+// callables
+// -----------------------------------------------------------------------------
+
+/// member
+///
+/// A member function pointer bound to an object.
+///
+template<class C, class MemFn>
+class member
+{
+public:
+    member(C *obj, MemFn fn) noexcept :
+        m_obj{obj},
+        m_fn{fn}
+    {}
+
+    template<class... A>
+    decltype(auto) operator()(A&&... args) const
+    { return std::invoke(m_fn, m_obj, std::forward<A>(args)...); }
+
+private:
+    C *m_obj;
+    MemFn m_fn;
+};
+
+/// fixed member
+///
+/// A member function known at compile time bound to an object. Only the
+/// object pointer is stored.
+///
+template<class C, auto memfn>
+class fixed_member
+{
+public:
+    explicit fixed_member(C *obj) noexcept : m_obj{obj}
+    {}
+
+    template<class... A>
+    decltype(auto) operator()(A&&... args) const
+    { return std::invoke(memfn, m_obj, std::forward<A>(args)...); }
+
+private:
+    C *m_obj;
+};
+
+/// bind
+///
+/// Binds a compile-time member function to obj, e.g. bind<&bar::baz>(&b).
+/// The result is pointer sized and can be stored by any policy.
+///
+template<auto memfn, class C>
+fixed_member<C, memfn> bind(C *obj) noexcept
+{ return fixed_member<C, memfn>(obj); }
+
+// -----------------------------------------------------------------------------
+// basic delegate
+// -----------------------------------------------------------------------------
+
+/// basic delegate
+///
+/// One delegate for every storage and dispatch combination. The storage
+/// policy decides where the callable lives and the dispatch policy how
+/// it is copied, moved and destroyed; invocation is always a single
+/// indirect call through m_call, whatever the policies.
+///
+template<class Storage, class Dispatch, class Ret, class... Args>
+class basic_delegate : private Dispatch::template ops<Storage>
+{
+    using ops_t = typename Dispatch::template ops<Storage>;
+    using buffer_t = typename Storage::buffer;
+    using call_t = Ret(*)(const buffer_t &, Args&&...);
+
+public:
+    /// Raw function pointer
+    ///
+    basic_delegate(Ret(*fn)(Args...)) :
+        basic_delegate(std::in_place_type<decltype(fn)>, fn)
+    {}
+
+    /// Non-const memfn, non-const object
+    ///
+    template<class C>
+    basic_delegate(Ret(C::*memfn)(Args...), C *obj) :
+        basic_delegate(
+            std::in_place_type<member<C, decltype(memfn)>>,
+            make_member<member<C, decltype(memfn)>>(obj, memfn))
+    {}
+
+    /// Const memfn, non-const object
+    ///
+    template<class C, typename = std::enable_if_t<std::is_class_v<C>>>
+    basic_delegate(Ret(C::*memfn)(Args...) const, C *obj) :
+        basic_delegate(
+            std::in_place_type<member<C, decltype(memfn)>>,
+            make_member<member<C, decltype(memfn)>>(obj, memfn))
+    {}
+
+    /// Const memfn, const object
+    ///
+    template<class C, typename = std::enable_if_t<std::is_class_v<C>>>
+    basic_delegate(Ret(C::*memfn)(Args...) const, const C *obj) :
+        basic_delegate(
+            std::in_place_type<member<const C, decltype(memfn)>>,
+            make_member<member<const C, decltype(memfn)>>(obj, memfn))
+    {}
+
+    /// Any other callable
+    ///
+    template<
+        class F,
+        typename = std::enable_if_t<
+            !std::is_base_of_v<basic_delegate, std::decay_t<F>> &&
+            std::is_invocable_r_v<Ret, std::decay_t<F> &, Args...>
+        >
+    >
+    basic_delegate(F &&fn) :
+        basic_delegate(std::in_place_type<std::decay_t<F>>, std::forward<F>(fn))
+    {}
+
+    /// In-place callable
+    ///
+    template<class F, class G>
+    basic_delegate(std::in_place_type_t<F>, G &&fn) :
+        ops_t{ops_t::template make<F>()},
+        m_call{&call<F>}
+    { Storage::template create<F>(m_buf, std::forward<G>(fn)); }
+
+    /// Copy constructor
+    ///
+    basic_delegate(const basic_delegate &other) :
+        ops_t{other},
+        m_call{other.m_call}
+    { ops_t::copy(m_buf, other.m_buf); }
+
+    /// Move constructor
+    ///
+    basic_delegate(basic_delegate &&other) noexcept :
+        ops_t{other},
+        m_call{other.m_call}
+    { ops_t::move(m_buf, other.m_buf); }
+
+    /// Copy assignment
+    ///
+    /// Copies before destroying the current callable, so a copy that
+    /// throws (the callable's, or a pool allocation) leaves the delegate
+    /// unchanged.
+    ///
+    basic_delegate &operator=(const basic_delegate &other)
+    {
+        if (this != &other) {
+            *this = basic_delegate(other);
+        }
+
+        return *this;
+    }
+
+    /// Move assignment
+    ///
+    basic_delegate &operator=(basic_delegate &&other) noexcept
+    {
+        if (this != &other) {
+            ops_t::destroy(m_buf);
+            ops_t::operator=(other);
+            m_call = other.m_call;
+            ops_t::move(m_buf, other.m_buf);
+        }
+
+        return *this;
+    }
+
+    /// Destructor
+    ///
+    ~basic_delegate()
+    { ops_t::destroy(m_buf); }
+
+    /// Call operator
+    ///
+    Ret operator()(Args... args) const
+    { return m_call(m_buf, std::forward<Args>(args)...); }
+
+private:
+    template<class M, class C, class MemFn>
+    static M make_member(C *obj, MemFn fn) noexcept
+    {
+        static_assert(Storage::template owns<M>,
+            "basic_delegate: storage cannot own a member function pointer and "
+            "object, use bind<&C::fn>(obj) instead");
+
+        return M(obj, fn);
+    }
+
+    template<class F>
+    static Ret call(const buffer_t &buf, Args&&... args)
+    {
+        static_assert(std::is_invocable_r_v<Ret, F &, Args...>);
+
+        if constexpr (std::is_void_v<Ret>) {
+            std::invoke(Storage::template get<F>(buf), std::forward<Args>(args)...);
+        }
+        else {
+            return std::invoke(Storage::template get<F>(buf), std::forward<Args>(args)...);
+        }
+    }
+
+    buffer_t m_buf;
+    call_t m_call;
+};
+
+// -----------------------------------------------------------------------------
+// delegate
+// -----------------------------------------------------------------------------
+
+/// delegate
+///
+/// The default combination: inline storage with a vtable, which matches
+/// the placement delegate.
+///
+template<class Ret, class... Args>
+class delegate : public basic_delegate<inline_storage<>, vtable_dispatch, Ret, Args...>
+{
+    using base = basic_delegate<inline_storage<>, vtable_dispatch, Ret, Args...>;
+
+public:
+    using base::base;
+};
+
+/// Class deduction guides
+
+template<class R, class... A>
+delegate(R(A...)) -> delegate<R, A...>;
+
+template<class C, class R, class... A>
+delegate(R(C::*)(A...), C*) -> delegate<R, A...>;
+
+template<class C, class R, class... A>
+delegate(R(C::*)(A...) const, C*) -> delegate<R, A...>;
+
+template<class C, class R, class... A>
+delegate(R(C::*)(A...) const, const C*) -> delegate<R, A...>;
+
+#endif
@@ -0,0 +1,107 @@
+#include "delegate.h"
+#include <iostream>
+#include <typeinfo>
+#include <unistd.h>
+#include <cstdio>
+#include <stdexcept>
+
+int foo()
+{
+    return 1;
+}
+
+int biz(int n)
+{
+    return rand() * rand() * n;
+}
+
+struct bar {
+    bar() : val{rand() % 8} {}
+    int baz() { return rand() % 2; }
+    int fiz() const { return val + (rand() % 2); }
+    int val;
+};
+
+struct counted {
+    counted() { live++; }
+    counted(const counted &)
+    {
+        if (fail) {
+            throw std::runtime_error("counted: copy failed");
+        }
+        live++;
+    }
+    counted(counted &&) noexcept { live++; }
+   ~counted() { live--; }
+    int operator()(int n) const { return n; }
+
+    static inline int live;
+    static inline bool fail;
+};
+
+template<class Ret, class... Args>
+using pooled_delegate = basic_delegate<pooled_storage<>, manager_dispatch, Ret, Args...>;
+
+template<class Ret, class... Args>
+using ref_delegate = basic_delegate<ref_storage, trivial_dispatch, Ret, Args...>;
+
+int main()
+{
+    bar b;
+
+    const bar c;
+
+    delegate bizd(&biz);
+    delegate food(&foo);
+    delegate bazd(&bar::baz, &b);
+    delegate fizd(&bar::fiz, &b);
+    delegate cizd(&bar::fiz, &c);
+
+    auto bizc = bizd;
+    auto cizm = std::move(cizd);
+
+    int big[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    auto sum = [big](int n) { return big[0] + big[7] + n; };
+
+    pooled_delegate<int, int> sumd(sum);
+    pooled_delegate<int> bazp(&bar::baz, &b);
+    auto sumc = sumd;
+
+    ref_delegate<int, int> sumr(sum);
+    ref_delegate<int> bazr(bind<&bar::baz>(&b));
+
+    auto live = 0;
+    {
+        delegate<int, int> cnta(counted{});
+        delegate<int, int> cntb(counted{});
+
+        counted::fail = true;
+        try {
+            cnta = cntb;
+        }
+        catch (const std::runtime_error &) {
+        }
+        counted::fail = false;
+
+        live = counted::live;
+    }
+
+    static_assert(std::is_same_v<decltype(bizd), delegate<int, int>>);
+    static_assert(std::is_same_v<decltype(bizd), decltype(bizc)>);
+    static_assert(std::is_same_v<decltype(food), delegate<int>>);
+    static_assert(std::is_same_v<decltype(bazd), delegate<int>>);
+    static_assert(std::is_same_v<decltype(fizd), delegate<int>>);
+    static_assert(std::is_same_v<decltype(cizm), delegate<int>>);
+
+    printf("bizd(2) == %d, sizeof == %lu\n", bizd(2), sizeof(bizd));
+    printf("bizc(2) == %d, sizeof == %lu\n", bizc(2), sizeof(bizc));
+    printf("food() == %d, sizeof == %lu\n", food(), sizeof(food));
+    printf("bazd() == %d, sizeof == %lu\n", bazd(), sizeof(bazd));
+    printf("fizd() == %d, sizeof == %lu\n", fizd(), sizeof(fizd));
+    printf("cizm() == %d, sizeof == %lu\n", cizm(), sizeof(cizm));
+    printf("sumc(1) == %d, sizeof == %lu\n", sumc(1), sizeof(sumc));
+    printf("bazp() == %d, sizeof == %lu\n", bazp(), sizeof(bazp));
+    printf("sumr(1) == %d, sizeof == %lu\n", sumr(1), sizeof(sumr));
+    printf("bazr() == %d, sizeof == %lu\n", bazr(), sizeof(bazr));
+    printf("live after a failed copy: %d, after destruction: %d\n", live, counted::live);
+}